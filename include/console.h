@@ -0,0 +1,241 @@
+﻿/**
+ * @file console.h
+ * @author Haolin Yang
+ * @brief 命令行指令的解析、分发和结果输出
+ * @version 0.1
+ * @date 2022-04-10
+ *
+ * @copyright Copyright (c) 2022
+ *
+ * @note 所有指令登记在一张表中, 每条指令给出参数格式, 输入先按格式解析为带类型的参数, 再交给处理函数.
+ * @note 处理函数用解析好的参数直接调用UserManage, 改变会话状态的操作调用RequestHandler的对应入口, 只把结果交给Renderer输出为文本.
+ * @note 一行输入可以是空格分隔的文本指令, 也可以是Json请求(以"{"开头), 格式同服务方式, 见RequestHandler::handle.
+ */
+
+#ifndef CONSOLE_H
+#define CONSOLE_H
+
+#include <QVariant>
+#include "logger.h"
+#include "request.h"
+
+/**
+ * @brief 以文本逐行输出一条指令的结果
+ * @note 结果通过Logger::writeResult写到stdout, 不会被丢弃.
+ */
+class Renderer
+{
+public:
+    /**
+     * @brief 输出失败信息, 并记录本条指令失败
+     */
+    void fail(const QString &text);
+
+    /**
+     * @brief 本条指令是否失败
+     */
+    bool hasFailed() const { return failed; }
+
+    void message(const QString &text); //输出一条普通信息
+    void item(const QJsonObject &item); //输出一个物品, 格式同UserManage::queryItem的结果
+    void user(const QJsonObject &user); //输出一个用户, 格式同UserManage::getUserInfo的结果
+    void stat(const QJsonObject &row);  //输出一行分组统计, 格式同UserManage::aggregateItem的结果
+
+private:
+    bool failed = false; //本条指令是否失败
+};
+
+/**
+ * @brief 命令行, 逐行执行文本指令或Json请求, 保存当前会话的凭据和分页状态
+ */
+class Console
+{
+public:
+    /**
+     * @brief 禁止默认的构造函数
+     * @note 用不上
+     */
+    Console() = delete;
+
+    Console(Database *_db, ItemManage *_itemManage, UserManage *_userManage) : db(_db), itemManage(_itemManage), userManage(_userManage), handler(_userManage) {}
+
+    /**
+     * @brief 设置批处理模式
+     * @note 批处理模式下修改类指令在事务中执行, 每BATCH_GROUP_SIZE条提交一次; 查询在同一连接上能看到未提交的修改, 不需要提交.
+     * @note 不能在事务中执行的指令(快照和恢复)执行前先提交.
+     */
+    void setBatch(bool _batch) { batch = _batch; }
+
+    /**
+     * @brief 执行一行指令
+     * @param line 文本指令或Json请求
+     * @return true 继续读取下一行
+     * @return false 指令为exit
+     * @note Json请求与服务方式的请求相同, 使用当前会话的凭据, 响应以一行Json输出, 格式见RequestHandler::handle.
+     */
+    bool execute(const QString &line);
+
+    /**
+     * @brief 提交批处理模式下未提交的事务
+     * @return true 提交成功或没有未提交的事务
+     * @return false 提交失败, 事务已回滚, 其中执行成功的指令都计为失败; 已登录的用户被登出
+     */
+    bool finish();
+
+    int getCommandCount() const { return commandCount; }
+    int getFailureCount() const { return failureCount; }
+
+private:
+    /**
+     * @brief 参数类型
+     */
+    enum ArgType
+    {
+        ARG_INT,           //整数
+        ARG_STRING,        //字符串
+        ARG_INT_OR_ANY,    //整数或*, *表示不限制
+        ARG_STRING_OR_ANY, //字符串或*
+        ARG_DATE_OR_ANY,   //年/月/日或*, 解析为{"year", "month", "day"}
+    };
+
+    /**
+     * @brief 指令的属性
+     */
+    enum CommandFlag
+    {
+        MUTATING = RequestHandler::MUTATING,             //修改数据, 批处理模式下合并进事务
+        NO_TRANSACTION = RequestHandler::NO_TRANSACTION, //不能在事务中执行
+        NEED_LOGIN = 4,                                  //需要先登录
+    };
+
+    using Args = QVector<QVariant>; //解析后的参数, *解析为无效的QVariant
+
+    /**
+     * @brief 一条指令的一种格式
+     */
+    struct Command
+    {
+        QString verb;                                      //指令名
+        QVector<ArgType> args;                             //参数格式
+        bool variadic;                                     //是否接受更多的字符串参数
+        int flags;                                         //CommandFlag的组合
+        void (Console::*run)(const Args &, Renderer &out); //处理函数, exit为nullptr
+        QString description;                               //帮助中的说明, 为空时不在帮助中列出
+        QString usage;                                     //帮助中的用法
+        QStringList notes;                                 //帮助中的补充说明
+    };
+
+    /**
+     * @brief 所有指令, 按帮助中的顺序
+     */
+    static const QVector<Command> &commandList();
+
+    /**
+     * @brief 指令名到它的各种格式
+     */
+    static const QHash<QString, QVector<const Command *>> &commandTable();
+
+    /**
+     * @brief 按参数格式解析参数
+     * @param command 指令格式
+     * @param words 参数
+     * @param ret 解析后的参数
+     * @return QString 成功则返回空串，否则返回错误信息
+     */
+    static QString parseArgs(const Command &command, const QStringList &words, Args &ret);
+
+    /**
+     * @brief 执行一条指令
+     * @param verb 指令名
+     * @param words 参数
+     * @param out 结果输出
+     * @return false 指令为exit
+     */
+    bool dispatch(const QString &verb, const QStringList &words, Renderer &out);
+
+    /**
+     * @brief 执行一个Json请求并输出响应
+     * @param line 请求行
+     * @return true 请求成功
+     * @return false 请求失败
+     */
+    bool dispatchJson(const QString &line);
+
+    /**
+     * @brief 批处理模式下, 按指令的属性提交或开始事务
+     * @param flags CommandFlag的组合
+     * @return true 指令在事务中执行, 成功后应计入groupSize
+     */
+    bool prepareGroup(int flags);
+
+    /**
+     * @brief 检查一个操作的返回值, 失败时输出失败信息
+     * @param ret 操作的返回值, 成功为空串，否则为错误信息
+     * @param prefix 失败时输出在错误信息前的文字
+     * @param out 结果输出
+     * @return true 成功
+     * @return false 失败, 已输出失败信息; 会话已失效时凭据被清空
+     */
+    bool check(const QString &ret, const QString &prefix, Renderer &out);
+
+    /**
+     * @brief 用query/querysrc/querydst的参数构造查询条件
+     * @param type 查询类型
+     * @param args 单号、寄送时间年月日、接收时间年月日, 之后是用户名
+     * @param nameKeys 用户名参数对应的条件键
+     */
+    static QJsonObject itemFilter(int type, const Args &args, const QStringList &nameKeys);
+
+    /**
+     * @brief 执行一次物品查询，开启分页时只显示一页，并记住条件以便 next 继续
+     */
+    void runQuery(QJsonObject filter, Renderer &out);
+
+    void help(const Args &args, Renderer &out);
+    void time(const Args &args, Renderer &out);
+    void addTime(const Args &args, Renderer &out);
+    void registerUser(const Args &args, Renderer &out);
+    void login(const Args &args, Renderer &out);
+    void logout(const Args &args, Renderer &out);
+    void changePassword(const Args &args, Renderer &out);
+    void info(const Args &args, Renderer &out);
+    void allUserInfo(const Args &args, Renderer &out);
+    void addBalance(const Args &args, Renderer &out);
+    void queryAllItem(const Args &args, Renderer &out);
+    void query(const Args &args, Renderer &out);
+    void querySrc(const Args &args, Renderer &out);
+    void queryDst(const Args &args, Renderer &out);
+    void queryRange(const Args &args, Renderer &out);
+    void explain(const Args &args, Renderer &out);
+    void send(const Args &args, Renderer &out);
+    void receive(const Args &args, Renderer &out);
+    void snapshot(const Args &args, Renderer &out);
+    void restore(const Args &args, Renderer &out);
+    void stats(const Args &args, Renderer &out);
+    void cacheStats(const Args &args, Renderer &out);
+    void count(const Args &args, Renderer &out);
+    void pageSizeCommand(const Args &args, Renderer &out);
+    void next(const Args &args, Renderer &out);
+
+    static const int BATCH_GROUP_SIZE = 256; //批处理模式下一个事务最多包含的修改类指令数
+
+    Database *db;                        //数据库
+    ItemManage *itemManage;              //物品管理
+    UserManage *userManage;              //用户管理
+    RequestHandler handler;              //Json请求的处理, 与服务方式共用操作表
+    QJsonValue token = QJsonValue::Null; //当前的凭据, 未登录时为Null
+
+    int pageSize = 0;       //每页显示的物品数，0表示不分页
+    bool pageDesc = false;  //分页时是否从新到旧显示
+    QJsonObject pageFilter; //上一页的查询条件，没有下一页时为空
+    int pageLastId = -1;    //上一页最后一个物品的单号
+    int pageCount = 0;      //上一页显示的物品数
+
+    bool batch = false;   //是否为批处理模式
+    bool inGroup = false; //批处理模式下是否有未提交的事务
+    int groupSize = 0;    //未提交的事务中执行成功的修改类指令数
+    int commandCount = 0; //执行的指令数
+    int failureCount = 0; //失败的指令数
+};
+
+#endif // CONSOLE_H
@@ -7,7 +7,8 @@
  *
  * @copyright Copyright (c) 2022
  *
- * @note 用户信息使用txt文件存储，快递信息使用sqlite数据库存储。
+ * @note 用户信息和快递信息都使用sqlite数据库存储，分别位于user表和item表。
+ * @note 旧版本的用户txt文件(及其修改日志)在首次创建user表时自动导入，导入后改名为<用户文件名>.migrated。
  * @note 对于用户部分, 定义了插入用户(注册), 查询用户, 修改用户密码, 修改用户余额的接口.
  * @note 对于物品部分, 定义了插入物品, 查询物品(根据发送人/接收人/时间/快递单号即id), 修改物品信息, 删除物品的接口.
  */
@@ -15,8 +16,15 @@
 #ifndef DATABASE_H
 #define DATABASE_H
 
+#include <QElapsedTimer>
 #include <QFile>
+#include <QMutex>
+#include <QQueue>
+#include <QThread>
+#include <QThreadStorage>
+#include <QWaitCondition>
 #include <QtSql>
+#include <functional>
 
 #include "item.h"
 
@@ -26,14 +34,54 @@ class User;
 
 const int CUSTOMER = 0;
 const int ADMINISTRATOR = 1;
+
+/**
+ * @brief 用户记录, 对应旧版用户文件中的一行(不含用户名), 仅在导入时使用
+ */
+struct UserRecord
+{
+    QString password;    //密码
+    int type;            //用户类型
+    int balance;         //余额
+    QString name;        //姓名
+    QString phoneNumber; //电话号码
+    QString address;     //地址
+};
+
+/**
+ * @brief 数据库的存储配置, 打开数据库时以PRAGMA的形式应用
+ * @note 字符串为空或数值为默认值的项保持SQLite的默认设置.
+ */
+struct StorageConfig
+{
+    QString path = "MyDataBase.sqlite"; //数据库文件路径
+    QString journalMode;                //日志模式: DELETE、TRUNCATE、PERSIST、MEMORY、WAL或OFF
+    QString synchronous;                //同步级别: OFF、NORMAL、FULL或EXTRA
+    int cacheSize = 0;                  //页缓存大小, 正数为页数, 负数为KiB数
+    qint64 mmapSize = -1;               //内存映射的最大字节数, 0表示不使用mmap
+    QString tempStore;                  //临时表和索引的位置: DEFAULT、FILE或MEMORY
+
+    /**
+     * @brief 从Json配置文件读取存储配置
+     * @param fileName 配置文件名, 键为path、journal_mode、synchronous、cache_size、mmap_size、temp_store, 均可省略
+     * @return StorageConfig 存储配置, 文件不存在或格式有误时为默认配置
+     */
+    static StorageConfig fromFile(const QString &fileName);
+
+    /**
+     * @brief 纯内存存储的配置, 数据库为SQLite的:memory:, 不导入旧版用户文件
+     * @return StorageConfig 存储配置
+     * @note 进程退出后数据全部丢失, 需要保留时用Database::snapshot保存.
+     */
+    static StorageConfig inMemory();
+};
+
 /**
  * @brief 数据库类
  */
 class Database
 {
 public:
-    QSet<QString> usernameSet; //用户名集合
-
     /**
      * @brief 删除默认构造函数
      */
@@ -42,12 +90,19 @@ public:
     /**
      * @brief 构造函数
      * @param connectionName 连接名称
-     * @param fileName 文件名
+     * @param fileName 旧版用户文件名
+     * @param config 存储配置
      *
-     * @note 检查是否存在user、item两个table，如果不存在某个表则创建；同时打开用户名文件，将用户名信息读取到usernameSet中。
+     * @note 检查是否存在user、item两个table，如果不存在某个表则创建；创建user表时从旧版用户文件导入全部用户。
      *
      */
-    Database(const QString &connectionName, const QString &fileName);
+    Database(const QString &connectionName, const QString &fileName, const StorageConfig &config = StorageConfig());
+
+    /**
+     * @brief 析构函数, 提交组提交模式下尚未提交的修改并结束写线程
+     * @note 其他使用过数据库的线程应在此之前结束.
+     */
+    ~Database();
 
     /**
      * @brief 插入用户条目
@@ -59,8 +114,10 @@ public:
      * @param name 姓名
      * @param phoneNumber 电话号码
      * @param address 地址
+     * @return true 插入成功
+     * @return false 插入失败, 包括用户名已存在
      */
-    void insertUser(const QString &username, const QString &password, int type, int balance, const QString &name, const QString &phoneNumber, const QString &address);
+    bool insertUser(const QString &username, const QString &password, int type, int balance, const QString &name, const QString &phoneNumber, const QString &address);
 
     /**
      * @brief 根据用户名查询用户是否存在
@@ -85,6 +142,12 @@ public:
      */
     bool queryUserByName(const QString &targetUsername, QString &retPassword, int &retType, int &retBalance, QString &retName, QString &retPhoneNumber, QString &retAddress) const;
 
+    /**
+     * @brief 获得所有用户名
+     * @return QStringList 所有用户名
+     */
+    QStringList queryAllUsername() const;
+
     /**
      * @brief 获得用户名对应的余额
      * @param username
@@ -100,7 +163,7 @@ public:
      * @return true 修改成功
      * @return false 修改失败
      */
-    bool modifyUserPassword(const QString &targetUsername, const QString &targetPassword) const;
+    bool modifyUserPassword(const QString &targetUsername, const QString &targetPassword);
 
     /**
      * @brief 修改用户余额
@@ -110,14 +173,126 @@ public:
      * @return true 修改成功
      * @return false 修改失败
      */
-    bool modifyUserBalance(const QString &targetUsername, int targetBalance) const;
+    bool modifyUserBalance(const QString &targetUsername, int targetBalance);
 
     /**
-     * @brief 查询表中主键的最大值
-     * @param tableName 数据库表名
-     * @return 返回最大主键允许的s值
+     * @brief 在一个事务中从一个用户转账给另一个用户
+     *
+     * @param srcUsername 转出用户的用户名
+     * @param dstUsername 转入用户的用户名
+     * @param amount 转账金额
+     * @return true 转账成功
+     * @return false 转账失败, 两个用户的余额都不变
+     * @note 余额上下限由调用者检查.
+     */
+    bool transferBalance(const QString &srcUsername, const QString &dstUsername, int amount);
+
+    /**
+     * @brief 开始事务
+     * @return true 成功
+     * @return false 失败
+     * @note 可以嵌套, 内层事务使用SAVEPOINT实现, 只有最外层提交时才写入磁盘.
+     */
+    bool beginTransaction();
+
+    /**
+     * @brief 提交最内层的事务
+     * @return true 成功
+     * @return false 失败, 此时仍需调用rollbackTransaction
+     */
+    bool commitTransaction();
+
+    /**
+     * @brief 回滚最内层的事务
+     * @return true 成功
+     * @return false 失败
+     */
+    bool rollbackTransaction();
+
+    /**
+     * @brief 设置组提交模式, 应在其他线程使用数据库之前调用
+     * @param maxOps 组事务积累maxOps次修改后提交, 不大于0时关闭组提交, 每次修改单独提交
+     * @param maxDelay 组事务打开超过maxDelay毫秒后提交, 不大于0时使用GROUP_COMMIT_DEFAULT_DELAY
+     * @note 开启后由一个写线程用自己的连接执行所有线程经groupWrite提交的修改: 修改进入队列, 写线程依次在同一个组事务中执行,
+     * @note 达到maxOps次或maxDelay毫秒时提交一次, 多个线程的修改共享一次提交.
+     * @note 修改执行完就返回结果, 此时尚未提交, 其他连接的查询看不到它们; 需要持久化的调用者再调用waitGroupCommit.
+     * @note 组事务占用SQLite的写锁, 其他连接上的写(如用户表的修改)要等它提交, 最多约maxDelay毫秒.
+     * @note 纯内存存储时不能开启(见isInMemory), 设置被忽略.
+     */
+    void setGroupCommit(int maxOps, int maxDelay);
+
+    /**
+     * @brief 执行一次修改(可以包含多条语句), 作为一个整体成功或回滚
+     * @param write 执行修改的函数, 返回false时它的修改被回滚
+     * @return bool write的返回值, 开始或提交事务失败时也返回false
+     * @note 组提交模式下且当前线程不在事务中时, write交给写线程在组事务中执行(运行在写线程上, 访问数据库使用写线程的连接),
+     * @note 当前线程等到它执行完才返回; 否则在当前线程的连接上、一个(嵌套的)事务中执行.
+     */
+    bool groupWrite(const std::function<bool()> &write);
+
+    /**
+     * @brief 等待当前线程交给写线程的修改全部提交, 不会使组事务提前提交
+     * @return true 都已提交或没有待提交的修改
+     * @return false 其中有修改所在的组事务提交失败, 这些修改已丢失
+     * @note 只检查上次调用之后的修改. 并发的调用者等待同一次提交.
+     */
+    bool waitGroupCommit();
+
+    /**
+     * @brief 立即提交写线程已收到的所有修改, 并等待提交完成
+     * @return true 提交成功或没有待提交的修改
+     * @return false 提交失败(组事务中的修改全部丢失), 或当前线程此前的修改有提交失败的
      */
-    int getDBMaxId(const QString &tableName) const;
+    bool flushGroupCommit();
+
+    /**
+     * @brief 在sequence表中预留一段连续的物品单号
+     * @param count 预留的数量
+     * @return int 第一个单号, 失败时为-1
+     * @note 预留与sequence表的修改在同一事务中, 多个线程或进程同时预留也不会重复.
+     * @note 所在的事务回滚后预留的单号不再有效, 见getReservationEpoch.
+     */
+    int reserveItemIds(int count);
+
+    /**
+     * @brief 获得单号预留的版本, 每次回滚事务或恢复快照时加一
+     * @return int 版本
+     * @note 在某个版本下预留的单号, 只有版本不变时才能使用.
+     */
+    int getReservationEpoch() const;
+
+    /**
+     * @brief 获得用于判断一个物品的查询结果能否缓存的版本
+     * @param id 物品单号
+     * @return int 版本, 每次有修改过物品的最外层事务结束(提交或回滚)时加一; 有未结束的事务修改过这个物品时返回-1
+     * @note 查询前后取得的版本相同且不为-1时, 查询期间这个物品没有未提交的修改, 查到的是已提交的数据, 可以放入缓存.
+     * @note 只有修改过这个物品(或恢复快照)的事务使其返回-1, 其他事务(如组提交的写线程、批处理)打开时缓存仍然可用.
+     */
+    int getCacheEpoch(const int id) const;
+
+    /**
+     * @brief 是否为纯内存存储
+     * @note 共享缓存的内存数据库在多个连接同时写时返回SQLITE_LOCKED, 不会按busy_timeout重试, 因此只应由一个线程访问.
+     */
+    bool isInMemory() const { return storageConfig.path == ":memory:"; }
+
+    /**
+     * @brief 将整个数据库(用户和物品)保存为快照文件
+     * @param path 快照文件路径, 已存在时被替换
+     * @return true 成功
+     * @return false 失败, 原有的快照文件不变
+     * @note 先提交组事务; 在调用者的事务中不能保存.
+     */
+    bool snapshot(const QString &path);
+
+    /**
+     * @brief 用快照文件中的用户和物品替换数据库中的全部数据
+     * @param path 由snapshot保存的快照文件路径
+     * @return true 成功
+     * @return false 失败, 数据库不变
+     * @note 先提交组事务; 在调用者的事务中不能恢复.
+     */
+    bool restore(const QString &path);
 
     /**
      * @brief 插入物品
@@ -130,27 +305,77 @@ public:
      * @param srcName 寄件用户的用户名
      * @param dstName 收件用户的用户名
      * @param description 物品描述
+     * @return true 插入成功
+     * @return false 插入失败
+     */
+    bool insertItem(int id, int cost, int state, const Time &sendingTime, const Time &receivingTime, const QString &srcName, const QString &dstName, const QString &description);
+
+    /**
+     * @brief 在一个事务中批量插入物品
+     *
+     * @param firstId 第一个物品的主键, 之后的物品依次加一
+     * @param items 待插入物品
+     * @return true 全部插入成功
+     * @return false 插入失败, 事务已回滚
      */
-    void insertItem(int id, int cost, int state, const Time &sendingTime, const Time &receivingTime, const QString &srcName, const QString &dstName, const QString &description);
+    bool insertItems(int firstId, const QVector<ItemDescriptor> &items);
 
     /**
-     * @brief 将数据库的Item查询结果转换成指向Item的指针
+     * @brief 将数据库的Item查询结果直接构造在结果数组的末尾
      * @param sqlQuery Item类的查询结果
-     * @return QSharedPointer<Item> 一个指向新创建的Item类的指针
+     * @param result 结果数组
      */
-    QSharedPointer<Item> query2Item(const QSqlQuery &sqlQuery) const;
+    static void query2Item(const QSqlQuery &sqlQuery, ItemList &result);
 
     /**
      * @brief 根据条件查询物品
      * @param result 用于返回结果
-     * @param id 物品单号
-     * @param sendingTime 寄送时间
-     * @param receivingTime 接收时间
-     * @param srcName 寄件用户的用户名
-     * @param dstName 收件用户的用户名
+     * @param filter 查询条件, 设置了afterId或limit时按单号分页
      * @return int 查到符合条件的数量
+     * @note 结果追加到result末尾; 按单号查询或分页时按行数上限预留空间.
+     */
+    int queryItemByFilter(ItemList &result, const ItemFilter &filter) const;
+
+    /**
+     * @brief 根据条件逐行查询物品, 每查到一行就交给visitor处理, 不保存结果
+     * @param filter 查询条件
+     * @param visitor 处理一行结果的函数, 返回false时停止查询
+     * @return int 交给visitor处理的行数
+     * @note Item对象只在visitor调用期间有效; visitor中不要再用相同的条件查询物品.
+     */
+    int visitItemByFilter(const ItemFilter &filter, const std::function<bool(const Item &)> &visitor) const;
+
+    /**
+     * @brief 获得queryItemByFilter在相同条件下的查询计划(EXPLAIN QUERY PLAN)
+     * @param filter 查询条件
+     * @return QStringList 查询计划的每一行
+     * @note 只与哪些条件生效有关，与条件的值无关.
      */
-    int queryItemByFilter(QList<QSharedPointer<Item>> &result, int id, const Time &sendingTime, const Time &receivingTime, const QString &srcName, const QString &dstName) const;
+    QStringList explainItemFilter(const ItemFilter &filter) const;
+
+    /**
+     * @brief 统计符合条件的物品数量(COUNT), 不读取物品的各列
+     * @param filter 查询条件, 忽略limit和descending
+     * @return int 符合条件的数量, 查询失败时为-1
+     */
+    int countItemByFilter(const ItemFilter &filter) const;
+
+    /**
+     * @brief 只查询符合条件的物品单号
+     * @param ids 结果追加到末尾
+     * @param filter 查询条件
+     * @return int 查到符合条件的数量
+     */
+    int queryItemIdByFilter(QVector<int> &ids, const ItemFilter &filter) const;
+
+    /**
+     * @brief 按条件分组统计物品数量和花费总和(GROUP BY), 只返回每个分组的一行
+     * @param result 结果追加到末尾
+     * @param filter 查询条件, 忽略afterId、limit和descending
+     * @param groupBy 分组的列, 见GROUP_BY_SRC_NAME等常量
+     * @return int 分组的数量, 查询失败时为-1
+     */
+    int aggregateItemByFilter(QVector<ItemAggregate> &result, const ItemFilter &filter, int groupBy) const;
 
     /**
      * @brief 修改物品状态
@@ -170,23 +395,278 @@ public:
      */
     bool modifyItemReceivingTime(const int id, const Time receivingTime);
 
+    /**
+     * @brief 将待签收的物品标记为已签收, 用一条语句同时修改状态和接收时间
+     * @param id 物品单号
+     * @param receivingTime 接收时间
+     * @return int 1为修改成功, 0为物品不存在或不是待签收状态(未修改), -1为执行或提交失败
+     */
+    int markItemReceived(const int id, const Time &receivingTime);
+
+    /**
+     * @brief 设置SQL语句的采样跟踪间隔
+     * @param interval 每interval条语句记录一条及其耗时, 不大于0时关闭采样
+     * @note 编译时未定义DATABASE_SQL_TRACE时无效.
+     */
+    static void setTraceSampling(int interval);
+
     /**
      * @brief 删除物品
      * @param id 物品单号
      * @return true 删除成功
      * @return false 删除失败
      */
-    bool deleteItem(const int id) const;
+    bool deleteItem(const int id);
 
 private:
-    QSqlDatabase db;    // SQLite数据库
-    QString userFileName;     //永久存储用户信息文件
+    /**
+     * @brief 一个线程独占的数据库连接, 以及只属于这个连接的状态
+     * @note Qt的数据库连接不能跨线程使用, 每个线程第一次访问数据库时创建, 线程结束时销毁.
+     */
+    struct Connection
+    {
+        QString name;                                               //连接名称
+        QSqlDatabase db;                                            // SQLite数据库
+        int transactionDepth = 0;                                   //当前事务的嵌套层数
+        QVector<int> dirtyItems;                                    //当前最外层事务中修改过的物品单号, 见markItemDirty
+        bool dirtyAllItems = false;                                 //当前最外层事务是否修改了全部物品(恢复快照)
+        quint64 groupLastBatch = 0;                                 //组提交: 本线程的修改所在的最后一个组事务的序号
+        quint64 groupSyncedBatch = 0;                               //组提交: 上次waitGroupCommit时的groupLastBatch
+        QHash<QString, QSharedPointer<QSqlQuery>> statementCache;   // SQL语句到预编译语句的缓存
+        QHash<int, QSharedPointer<QSqlQuery>> filterStatementCache; // 条件掩码和查询列到预编译语句的缓存
+
+        /**
+         * @brief 析构函数, 释放预编译语句后关闭并移除连接
+         */
+        ~Connection();
+    };
+
+    QString baseConnectionName;                      //连接名称的前缀, 每个线程的连接再加上序号
+    StorageConfig storageConfig;                     //存储配置, 每个连接打开时应用
+    QString userFileName;                            //旧版用户信息文件, 仅用于导入
+    mutable QThreadStorage<Connection *> connections; //每个线程的连接
+    mutable QAtomicInt connectionCount;              //已创建的连接数, 用于生成连接名称
+    QAtomicInt reservationEpoch;                     //单号预留的版本, 见getReservationEpoch
+    mutable QMutex dirtyMutex;                       //保护以下三项
+    mutable QHash<int, int> dirtyItems;              //有未提交修改的物品单号到修改过它的未结束事务数
+    mutable int dirtyAllCount = 0;                   //修改了全部物品的未结束事务数
+    mutable int itemEpoch = 0;                       //修改过物品的最外层事务结束的次数, 见getCacheEpoch
+
+    /**
+     * @brief 交给写线程的一项任务, 由等待它的调用者持有
+     */
+    struct GroupJob
+    {
+        const std::function<bool()> *write = nullptr; //要执行的修改, 为空表示立即提交组事务
+        bool done = false;                            //是否已执行
+        bool result = false;                          //write的返回值, 或提交是否成功
+        quint64 batch = 0;                            //修改所在的组事务的序号, 修改失败时为0
+    };
+
+    static const int GROUP_COMMIT_DEFAULT_DELAY = 5; //组提交: 未给出maxDelay时组事务最长持续的毫秒数
+
+    int groupCommitMaxOps = 0;            //组提交: 积累多少次修改后提交, 0表示关闭
+    int groupCommitMaxDelay = 0;          //组提交: 组事务最长持续的毫秒数
+    QScopedPointer<QThread> groupWriter;  //组提交: 写线程, 关闭时为空
+    QMutex groupMutex;                    //组提交: 保护以下状态
+    QWaitCondition groupWake;             //组提交: 唤醒写线程
+    QWaitCondition groupDone;             //组提交: 通知等待执行或提交的调用者
+    QQueue<GroupJob *> groupQueue;        //组提交: 等待写线程执行的任务
+    quint64 groupBatch = 1;               //组提交: 当前(或下一个)组事务的序号
+    quint64 groupCommitted = 0;           //组提交: 序号不大于它的组事务都已结束
+    QVector<quint64> groupFailed;         //组提交: 提交失败的组事务的序号
+    bool groupStopping = false;           //组提交: 写线程是否应在队列清空后退出
+
+    /**
+     * @brief 获得当前线程的连接, 第一次调用时打开
+     * @return Connection& 当前线程的连接
+     */
+    Connection &connection() const;
+
+    /**
+     * @brief 记录当前连接结束了最外层事务(提交或回滚), 解除事务中修改过的物品的标记
+     */
+    void outerTransactionEnded();
+
+    /**
+     * @brief 在修改物品前标记它有未提交的修改, 直到当前连接的最外层事务结束
+     * @param id 物品单号, 为-1时标记全部物品
+     * @note 不在事务中时修改立即提交, 只使版本加一.
+     */
+    void markItemDirty(const int id) const;
+
+    /**
+     * @brief 获得SQL语句对应的预编译语句, 第一次使用时编译并缓存
+     * @param statement SQL语句
+     * @return QSqlQuery& 预编译语句, 绑定新的参数后即可执行
+     * @note 读取完查询结果后应调用finish释放语句.
+     */
+    QSqlQuery &prepareCached(const QString &statement) const;
+
+    /**
+     * @brief 在当前线程的连接上、一个(嵌套的)事务中执行一次修改
+     * @param write 执行修改的函数
+     * @return bool 修改和提交是否都成功, 失败时已回滚
+     */
+    bool writeInTransaction(const std::function<bool()> &write);
+
+    /**
+     * @brief 写线程的主循环: 依次执行队列中的修改, 按阈值提交组事务, 直到groupStopping且队列为空
+     */
+    void runGroupCommit();
+
+    /**
+     * @brief 通知写线程退出并等待它结束, 之前收到的修改都被提交
+     */
+    void stopGroupCommit();
+
+    /**
+     * @brief 以PRAGMA的形式在连接上应用存储配置, 不合法的项被忽略
+     * @param db 刚打开的连接
+     */
+    void applyStorageConfig(QSqlDatabase &db) const;
+
+    /**
+     * @brief 将一个物品绑定到插入语句上并执行
+     * @return true 插入成功
+     * @return false 插入失败
+     */
+    bool execInsertItem(int id, int cost, int state, const Time &sendingTime, const Time &receivingTime, const QString &srcName, const QString &dstName, const QString &description) const;
+
+    /**
+     * @brief 创建item表
+     * @return true 创建成功
+     * @return false 创建失败
+     * @note 寄送时间和接收时间各存为一个整数日期(见Time::toOrdinal).
+     */
+    bool createItemTable() const;
+
+    /**
+     * @brief 将旧版本(日期分为年月日三列)的item表转换为整数日期列
+     * @note 在一个事务中重建item表, 失败则退出程序.
+     */
+    void migrateItemTable();
+
+    /**
+     * @brief 为item表创建与常用查询条件对应的索引
+     * @note 使用IF NOT EXISTS, 每次启动都会调用, 旧数据库也会补上索引.
+     */
+    void createItemIndexes() const;
+
+    /**
+     * @brief 创建sequence表(若不存在), 用于分配物品单号
+     */
+    void createSequenceTable() const;
+
+    /**
+     * @brief 计算queryItemByFilter的条件掩码, 每个生效的条件占一位
+     * @return int 条件掩码
+     */
+    static int itemFilterMask(const ItemFilter &filter);
+
+    /**
+     * @brief 根据条件掩码生成WHERE子句, 分页时还包括ORDER BY和LIMIT子句
+     * @param mask 条件掩码
+     * @return QString WHERE子句, 没有条件时为空串
+     * @note 分页按单号(即rowid)排序, 游标条件是主键上的范围, 每页只读取limit行.
+     */
+    static QString itemFilterCondition(int mask);
+
+    /**
+     * @brief 将数据库的Item查询结果转换成Item对象
+     * @param sqlQuery Item类的查询结果, 列顺序同item表
+     * @return Item 物品
+     */
+    static Item readItem(const QSqlQuery &sqlQuery);
+
+    /**
+     * @brief 物品查询语句的SELECT列
+     */
+    enum ItemProjection
+    {
+        ALL_COLUMNS = 0, //物品的全部列
+        ID_ONLY = 1,     //只有单号
+        COUNT_ONLY = 2   //只有数量
+    };
+
+    /**
+     * @brief 执行物品查询, 把每一行交给rowVisitor处理
+     * @param filter 查询条件
+     * @param rowVisitor 处理当前行的函数, 返回false时停止查询
+     * @param projection 查询的列
+     * @return int 交给rowVisitor处理的行数
+     */
+    int visitItemRows(const ItemFilter &filter, const std::function<bool(const QSqlQuery &)> &rowVisitor, ItemProjection projection = ALL_COLUMNS) const;
+
+    /**
+     * @brief 获得条件掩码对应的物品查询语句, 第一次使用时编译并缓存
+     * @param mask 条件掩码
+     * @param projection 查询的列
+     * @return QSqlQuery& 预编译语句
+     */
+    QSqlQuery &prepareItemFilter(int mask, ItemProjection projection = ALL_COLUMNS) const;
+
+    /**
+     * @brief 将查询条件中生效的部分绑定到语句上
+     * @param sqlQuery 由itemFilterCondition生成的语句
+     * @param filter 查询条件
+     */
+    static void bindItemFilter(QSqlQuery &sqlQuery, const ItemFilter &filter);
+
+    /**
+     * @brief 创建user表并导入旧版用户文件(纯内存存储时不导入)
+     * @note 两者在同一个事务中; 失败时整个回滚并退出程序, 下次启动重新导入.
+     */
+    void createUserTable();
+
+    /**
+     * @brief 从旧版用户文件及其修改日志导入全部用户到user表, 在createUserTable的事务中调用
+     * @param migrated 返回是否导入了用户文件, 用户文件不存在时为false
+     * @return true 成功或用户文件不存在
+     * @return false 插入失败, 调用者应回滚
+     */
+    bool migrateUserFile(bool &migrated);
+
+    /**
+     * @brief 导入的事务提交后, 将用户文件改名为<用户文件名>.migrated并删除临时文件和修改日志
+     */
+    void archiveUserFile();
+
+    /**
+     * @brief 回放一个旧版用户修改日志
+     * @param logFileName 日志文件名
+     * @param userTable 回放的目标用户记录
+     * @return int 回放的记录条数
+     *
+     * @note 日志每行一条记录:
+     * I <用户名> <密码> <类型> <余额> <姓名> <电话号码> <地址>
+     * P <用户名> <新密码>
+     * B <用户名> <新余额>
+     */
+    static int replayUserLog(const QString &logFileName, QHash<QString, UserRecord> &userTable);
+
+    static QAtomicInt traceSampleInterval; //采样跟踪的间隔, 0为不采样
+    static QAtomicInt traceCounter;        //采样跟踪的语句计数
 
     /**
      * @brief 执行SQL语句
-     * @param sqlQuery
+     * @param sqlQuery 已绑定参数的语句
+     * @return true 执行成功
+     * @return false 执行失败
+     *
+     * @note 只有定义了DATABASE_SQL_TRACE时才会跟踪SQL语句, 否则只执行语句.
+     * @note 日志类别database.sql的debug级别打开时记录每条语句和绑定的参数(默认关闭).
+     * @note 设置了采样间隔时每隔若干条语句以info级别记录一条语句及其耗时.
+     */
+    static bool exec(QSqlQuery &sqlQuery);
+
+    /**
+     * @brief 执行一条不带参数的SQL语句
+     * @param statement SQL语句
+     * @return true 执行成功
+     * @return false 执行失败
      */
-    static void exec(const QSqlQuery &sqlQuery);
+    bool execStatement(const QString &statement) const;
 
     /**
      * @brief 通过数据库表名获得该表的主键
@@ -15,12 +15,21 @@
 #ifndef ITEM_H
 #define ITEM_H
 
+#include <QCache>
+#include <QMutex>
 #include <QSharedPointer>
+#include <QThreadStorage>
+#include <functional>
+#include <vector>
 #include "time.h"
 
 const int RECEIVED = 1;          //已签收
 const int PENDING_REVEICING = 2; //待签收
 
+const int GROUP_BY_SRC_NAME = 1;     //统计时按寄件用户分组
+const int GROUP_BY_STATE = 2;        //统计时按物品状态分组
+const int GROUP_BY_SENDING_DATE = 4; //统计时按寄送日期分组
+
 class Database;
 class Time;
 
@@ -46,7 +55,7 @@ public:
      * @param _srcName 寄件用户的用户名
      * @param _dstName 收件用户的用户名
      * @param _description 物品描述
-     * @note 注意是否使用std::move
+     * @note 按值传入, 再移动到成员中
      */
     Item(int _id,
          int _cost,
@@ -61,10 +70,14 @@ public:
           state(_state),
           sendingTime(_sendingTime),
           receivingTime(_receivingTime),
-          srcName(_srcName),
-          dstName(_dstName),
-          description(_description) {}
+          srcName(std::move(_srcName)),
+          dstName(std::move(_dstName)),
+          description(std::move(_description)) {}
 
+    Item(const Item &) = default;
+    Item(Item &&) = default;
+    Item &operator=(const Item &) = default;
+    Item &operator=(Item &&) = default;
     ~Item() = default;
 
     /**
@@ -126,6 +139,62 @@ protected:
     QString description; //物品描述
 };
 
+/**
+ * @brief 物品查询结果, Item对象按值连续存放
+ */
+using ItemList = std::vector<Item>;
+
+/**
+ * @brief 待插入物品的描述, 即除单号以外的全部属性
+ */
+struct ItemDescriptor
+{
+    int cost;            //快递花费
+    int state;           //物品状态
+    Time sendingTime;    //寄送时间
+    Time receivingTime;  //接收时间
+    QString srcName;     //寄件用户的用户名
+    QString dstName;     //收件用户的用户名
+    QString description; //物品描述
+};
+
+/**
+ * @brief 物品统计结果的一行, 即一个分组
+ * @note 没有参与分组的列保持默认值.
+ */
+struct ItemAggregate
+{
+    QString srcName;                     //寄件用户的用户名
+    int state = -1;                      //物品状态
+    Time sendingTime = Time(-1, -1, -1); //寄送日期
+    int count = 0;                       //物品数量
+    qint64 revenue = 0;                  //花费总和
+};
+
+/**
+ * @brief 物品查询条件
+ * @note 值为-1的单号、年为-1的时间、空的用户名表示该条件不生效.
+ * @note 时间范围都是闭区间, 在数据库中按整数日期做范围查询.
+ * @note 不给出年时的月、日(或给出年、日而不给出月时的日)无法表示为区间, 作为单独的条件, 值为-1时不生效.
+ */
+struct ItemFilter
+{
+    int id = -1;                           //物品单号
+    Time sendingFrom = Time(-1, -1, -1);   //寄送时间下限
+    Time sendingTo = Time(-1, -1, -1);     //寄送时间上限
+    Time receivingFrom = Time(-1, -1, -1); //接收时间下限
+    Time receivingTo = Time(-1, -1, -1);   //接收时间上限
+    int sendingMonth = -1;                 //寄送时间的月
+    int sendingDay = -1;                   //寄送时间的日
+    int receivingMonth = -1;               //接收时间的月
+    int receivingDay = -1;                 //接收时间的日
+    QString srcName;                       //寄件用户的用户名
+    QString dstName;                       //收件用户的用户名
+    int afterId = -1;                      //分页游标: 只返回单号在它之后的物品
+    int limit = -1;                        //每页最多返回的物品数
+    bool descending = false;               //分页时按单号从大到小排列
+};
+
 /**
  * @brief 物品管理类
  */
@@ -141,8 +210,9 @@ public:
     /**
      * @brief 构造函数
      * @param _db 数据库的指针
+     * @param cacheSize queryById缓存的最大物品数, 为0时不缓存
      */
-    ItemManage(Database *_db);
+    ItemManage(Database *_db, int cacheSize = 1024);
 
     /**
      * @brief 插入一个Item，会自动分配id.
@@ -154,7 +224,7 @@ public:
      * @param srcName 寄件用户的用户名
      * @param dstName 收件用户的用户名
      * @param description 物品描述
-     * @return int 为添加的快递分配的单号
+     * @return int 为添加的快递分配的单号, 插入失败时返回-1
      */
     int insertItem(
         const int cost,
@@ -165,33 +235,78 @@ public:
         const QString &dstName,
         const QString &description);
 
+    /**
+     * @brief 批量插入物品, 分配一段连续的id, 在一个事务中插入.
+     *
+     * @param items 待插入物品
+     * @param ids 用于返回为每个物品分配的单号, 与items一一对应
+     * @return true 全部插入成功
+     * @return false 插入失败, 所有物品都没有插入
+     */
+    bool insertItems(const QVector<ItemDescriptor> &items, QVector<int> &ids);
+
     /**
      * @brief 查询所有物品
      * @param result 用于返回结果
      * @return int 查到符合条件的数量
      */
-    int queryAll(QList<QSharedPointer<Item>> &result) const;
+    int queryAll(ItemList &result) const;
 
     /**
      * @brief 根据条件查询物品
      * @param result 用于返回结果
-     * @param id 物品单号
-     * @param sendingTime 寄送时间
-     * @param receivingTime 接收时间
-     * @param srcName 寄件用户的用户名
-     * @param dstName 收件用户的用户名
+     * @param filter 查询条件
      * @return int 查到符合条件的数量
      */
-    int queryByFilter(QList<QSharedPointer<Item>> &result, const int id = -1, const Time &sendingTime = Time(-1, -1, -1), const Time &receivingTime = Time(-1, -1, -1), const QString &srcName = "", const QString &dstName = "") const;
+    int queryByFilter(ItemList &result, const ItemFilter &filter) const;
 
     /**
-     * @brief 根据条件查询物品
-     * @param result 用于返回结果
+     * @brief 根据条件逐行查询物品, 不保存结果
+     * @param filter 查询条件
+     * @param visitor 处理一行结果的函数, 返回false时停止查询
+     * @return int 交给visitor处理的行数
+     */
+    int visitByFilter(const ItemFilter &filter, const std::function<bool(const Item &)> &visitor) const;
+
+    /**
+     * @brief 根据单号查询物品
+     * @param result 用于返回结果, 存在该物品时追加一个元素
      * @param id 物品单号
      * @return true 存在该物品
      * @return false 不存在该物品
+     * @note 查到的物品放入LRU缓存, 经ItemManage的修改会使缓存失效.
+     */
+    bool queryById(ItemList &result, const int id) const;
+
+    /**
+     * @brief 统计符合条件的物品数量, 不读取物品信息
+     * @param filter 查询条件
+     * @return int 符合条件的数量, 查询失败时为-1
+     */
+    int countByFilter(const ItemFilter &filter) const;
+
+    /**
+     * @brief 只查询符合条件的物品单号
+     * @param ids 用于返回结果
+     * @param filter 查询条件
+     * @return int 查到符合条件的数量
+     */
+    int idsByFilter(QVector<int> &ids, const ItemFilter &filter) const;
+
+    /**
+     * @brief 按条件分组统计物品数量和花费总和
+     * @param result 用于返回结果, 每个分组一行, 按分组的列排序
+     * @param filter 查询条件, 分页的条件不生效
+     * @param groupBy 分组的列, GROUP_BY_SRC_NAME、GROUP_BY_STATE、GROUP_BY_SENDING_DATE的组合, 为0时只有一行总计
+     * @return int 分组的数量, 查询失败时为-1
      */
-    bool queryById(QSharedPointer<Item> &result, const int id) const;
+    int aggregateByFilter(QVector<ItemAggregate> &result, const ItemFilter &filter, int groupBy) const;
+
+    /**
+     * @brief 获得queryByFilter在相同条件下的查询计划
+     * @return QStringList 查询计划的每一行
+     */
+    QStringList explainByFilter(const ItemFilter &filter) const;
 
     /**
      * @brief 修改物品状态
@@ -202,7 +317,22 @@ public:
      */
     bool modifyState(const int id, const int state);
 
-    bool modifyReceivingTime(const int id,const Time &receivingTime);
+    /**
+     * @brief 修改物品接收时间
+     * @param id 物品单号
+     * @param receivingTime 接收时间
+     * @return true 修改成功
+     * @return false 修改失败
+     */
+    bool modifyReceivingTime(const int id, const Time &receivingTime);
+
+    /**
+     * @brief 签收物品, 状态和接收时间在同一条语句中修改
+     * @param id 物品单号
+     * @param receivingTime 接收时间
+     * @return int 1为签收成功, 0为物品不存在或已签收, -1为数据库错误
+     */
+    int markReceived(const int id, const Time &receivingTime);
 
     /**
      * @brief 从数据库中删除对应id的物品
@@ -212,8 +342,67 @@ public:
      */
     bool deleteItem(const int id) const;
 
+    /**
+     * @brief 等待当前线程之前的修改写入磁盘, 提交失败时清空缓存
+     * @return true 成功
+     * @return false 失败, 其中一部分修改已丢失
+     * @note 仅在组提交模式下需要: 修改在写线程执行完就返回, 见Database::waitGroupCommit.
+     */
+    bool sync() const;
+
+    /**
+     * @brief 从快照恢复数据库, 并清空缓存
+     * @note 恢复后各线程已预留的单号作废, 下次插入时从sequence表重新预留.
+     * @param path 快照文件路径
+     * @return true 成功
+     * @return false 失败
+     */
+    bool restore(const QString &path);
+
+    /**
+     * @brief 获得queryById缓存的命中次数
+     * @return int 命中次数
+     */
+    int getCacheHits() const { return cacheHits.loadRelaxed(); }
+
+    /**
+     * @brief 获得queryById缓存的未命中次数
+     * @return int 未命中次数
+     */
+    int getCacheMisses() const { return cacheMisses.loadRelaxed(); }
+
 private:
-    Database *db; //数据库
-    int total;    //物品ID允许的最大值
+    /**
+     * @brief 当前线程预留的一段单号[next, end)
+     */
+    struct IdBlock
+    {
+        int next = 0;   //下一个可用的单号
+        int end = 0;    //预留的单号上限(不含)
+        int epoch = -1; //预留时数据库的预留版本
+    };
+
+    static const int ID_BLOCK_SIZE = 64; //每次预留的单号数量
+
+    Database *db;                             //数据库
+    mutable QThreadStorage<IdBlock> idBlocks; //每个线程各自预留的单号, 取用时不加锁
+
+    /**
+     * @brief 使缓存中的物品失效
+     * @param id 物品单号, 为-1时清空缓存
+     */
+    void invalidate(const int id) const;
+
+    /**
+     * @brief 从当前线程的预留中取一个单号, 用完或已作废时重新预留
+     * @return int 单号, 失败时为-1
+     */
+    int allocateId();
+
+    mutable QCache<int, Item> itemCache; //单号到物品的LRU缓存, 只用于queryById
+    mutable QMutex cacheMutex;           //保护itemCache和cacheVersion, 各线程共用一个缓存
+    mutable int cacheVersion = 0;        //每次使缓存失效时加一
+    mutable QAtomicInt cacheHits;        //缓存命中次数
+    mutable QAtomicInt cacheMisses;      //缓存未命中次数
 };
 #endif
\ No newline at end of file
@@ -0,0 +1,135 @@
+﻿/**
+ * @file logger.h
+ * @author Haolin Yang
+ * @brief 异步日志
+ * @version 0.1
+ * @date 2022-04-10
+ *
+ * @copyright Copyright (c) 2022
+ *
+ * @note 接管Qt的消息输出. 调用qDebug等的线程只把消息格式化为一行, 放入无锁的环形缓冲区; 后台线程成批写出.
+ * @note Qt的消息都是日志, 写到日志文件, 没有日志文件时写到stdout(简洁格式下为stderr); 给用户看的结果由writeResult写到stdout.
+ * @note 缓冲区满时丢弃新的日志并计数, 后台线程会写出一条丢弃了多少条的提示; 结果不会丢弃. Fatal消息先等缓冲区写出, 再同步写出.
+ */
+
+#ifndef LOGGER_H
+#define LOGGER_H
+
+#include <QSemaphore>
+#include <QThread>
+#include <QtCore>
+#include <cstdio>
+
+class Logger
+{
+public:
+    /**
+     * @brief 禁止默认的构造函数
+     * @note 用不上
+     */
+    Logger() = delete;
+
+    /**
+     * @brief 启动后台写日志的线程并接管Qt的消息输出
+     * @param fileName 日志文件, 为空时日志写到stdout
+     * @param capacity 缓冲区能容纳的消息条数, 向上取为2的幂
+     * @note 同一时间只能有一个Logger. 析构时恢复Qt默认的消息输出, 并写出缓冲区中剩余的消息; 析构前应先停止其他输出日志的线程.
+     */
+    Logger(const QString &fileName, int capacity = 8192);
+
+    ~Logger();
+
+    Logger(const Logger &) = delete;
+    Logger &operator=(const Logger &) = delete;
+
+    /**
+     * @brief 设置是否使用简洁格式
+     * @note 简洁格式不带颜色和位置, 没有日志文件时日志写到stderr; 用于批处理模式stdout只有结果.
+     */
+    void setPlain(bool _plain) { plain.storeRelease(_plain); }
+
+    /**
+     * @brief 输出一行结果到stdout, 可以在任意线程调用
+     * @param text 结果, 不含换行
+     * @note 与日志经过同一个缓冲区以保持先后顺序; 缓冲区满时等待后台线程写出, 不会丢弃. 没有Logger时同步写出.
+     */
+    static void writeResult(const QString &text);
+
+    /**
+     * @brief 等待后台线程写出调用前放入缓冲区的全部消息
+     * @note 在exit等不会析构Logger的退出之前调用, 避免丢失最后的日志. 没有Logger时什么都不做.
+     */
+    static void flush();
+
+    /**
+     * @brief 获得因缓冲区满而丢弃的日志数
+     */
+    int getDroppedCount() const { return dropped.loadRelaxed(); }
+
+    /**
+     * @brief 按类别设置输出的最低级别
+     * @param levels 形如"default=warning,database.sql=debug"的规则, 类别可以用*通配, 后面的规则覆盖前面的
+     * @note 级别为debug, info, warning, critical, none之一. 结果不是日志, 不受级别影响.
+     * @note 被过滤的类别在qCDebug等处直接跳过, 不会格式化消息.
+     */
+    static void setLevels(const QString &levels);
+
+private:
+    /**
+     * @brief 缓冲区中的一格
+     * @note sequence等于写入位置时可写, 等于写入位置+1时可读(Vyukov的有界队列).
+     */
+    struct Cell
+    {
+        QAtomicInteger<quint32> sequence; //这一格的序号
+        QByteArray text;                  //格式化好的一行
+        FILE *stream;                     //写到哪里
+    };
+
+    /**
+     * @brief Qt的消息输出函数, 格式化后交给当前的Logger
+     */
+    static void messageHandler(QtMsgType type, const QMessageLogContext &context, const QString &msg);
+
+    /**
+     * @brief 放入一条消息, 可以在任意线程调用
+     * @param wait 缓冲区满时是否等待后台线程取走消息, 为false时丢弃
+     * @return false 缓冲区已满, 消息被丢弃
+     */
+    bool push(QByteArray &&text, FILE *stream, bool wait);
+
+    /**
+     * @brief 取出一条消息, 只在后台线程调用
+     * @return false 缓冲区为空
+     */
+    bool pop(QByteArray &text, FILE *&stream);
+
+    /**
+     * @brief 缓冲区是否为空, 只在后台线程调用
+     */
+    bool isEmpty() const;
+
+    /**
+     * @brief 后台线程, 成批写出缓冲区中的消息
+     */
+    void run();
+
+    static QAtomicPointer<Logger> current; //当前接管消息输出的Logger
+
+    static const int WRITE_BATCH = 256; //后台线程每次最多写出的消息数, 写完一批后flush
+
+    QScopedArrayPointer<Cell> cells; //环形缓冲区
+    quint32 mask;                    //缓冲区大小-1
+    QAtomicInteger<quint32> pushPos; //下一个写入位置
+    quint32 popPos = 0;              //下一个读取位置, 只有后台线程使用
+    QAtomicInteger<quint32> flushed; //已写出并flush的位置, 见flush
+    QAtomicInt dropped;              //丢弃的日志数
+    QAtomicInt plain;                //是否使用简洁格式
+    QAtomicInt waiting;              //后台线程是否在等待新消息
+    QAtomicInt stopping;             //后台线程是否应退出
+    QSemaphore wakeup;               //唤醒后台线程
+    FILE *logStream = nullptr;       //日志文件, 为空时日志按格式写到stdout或stderr
+    QScopedPointer<QThread> writer;  //后台线程
+};
+
+#endif // LOGGER_H
@@ -0,0 +1,157 @@
+﻿/**
+ * @file request.h
+ * @author Haolin Yang
+ * @brief Json请求的处理
+ * @version 0.1
+ * @date 2022-04-10
+ *
+ * @copyright Copyright (c) 2022
+ *
+ * @note 一个请求是一个Json对象, 用"op"键给出操作名, 其余键是对应UserManage函数的参数.
+ * @note 处理请求时不保存状态, 登录凭据由调用者(每个会话)各自保存.
+ * @note 服务方式的请求和命令行的Json指令使用同一张操作表.
+ * @note 改变会话状态的操作(注册、登录、登出、恢复快照)另有带类型参数的入口, 命令行的文本指令直接调用, 不经过Json.
+ */
+
+#ifndef REQUEST_H
+#define REQUEST_H
+
+#include "user.h"
+
+class RequestHandler
+{
+public:
+    /**
+     * @brief 禁止默认的构造函数
+     * @note 用不上
+     */
+    RequestHandler() = delete;
+
+    RequestHandler(UserManage *_userManage) : userManage(_userManage) {}
+
+    /**
+     * @brief 操作的属性
+     */
+    enum OperationFlag
+    {
+        MUTATING = 1,       //修改数据
+        NO_TRANSACTION = 2, //不能在事务中执行
+    };
+
+    static const QString NOT_LOGGED_IN; //未登录时的错误信息
+    static const QString LOGGED_IN;     //已登录时不能注册或登录的错误信息
+
+    /**
+     * @brief 处理一个请求
+     * @param request 请求
+     * @param token 会话的凭据, 未登录时为Null; login成功时被设置, logout和restore成功时被清空, 会话已失效(如被其他会话的restore清空)时也被清空
+     * @return QJsonObject 响应
+     * @note 请求和响应格式:
+     * ```json
+     * 请求: {
+     *      "op" : <字符串>, 操作名, 见下
+     *      可选："id" : <任意>, 原样放回响应中, 用于对应请求和响应
+     *      ...操作的参数
+     * }
+     * 响应: {
+     *      "id" : 同请求,
+     *      "ok" : <布尔>,
+     *      失败时："error" : <字符串>,
+     *      有结果时："result" : <Json>
+     * }
+     * ```
+     * @note 操作和参数:
+     * ```
+     * register        username password name phoneNumber address
+     * login           username password
+     * logout
+     * changePassword  password
+     * getUserInfo                             结果为用户信息对象
+     * queryAllUserInfo                        结果为用户信息数组
+     * addBalance      amount
+     * queryItem       filter                  结果为物品数组, filter格式同UserManage::queryItem
+     * countItem       filter                  结果为整数
+     * aggregateItem   filter                  结果为分组统计数组
+     * explainItemQuery filter                 结果为查询计划数组
+     * sendItem        dstName description
+     * receiveItem     itemId
+     * snapshot        path
+     * restore         path
+     * time                                    结果为{"year", "month", "day"}
+     * ```
+     */
+    QJsonObject handle(const QJsonObject &request, QJsonValue &token) const;
+
+    /**
+     * @brief 查询操作的属性
+     * @param op 操作名
+     * @return int OperationFlag的组合, 未知的操作为0
+     */
+    static int getFlags(const QString &op);
+
+    /**
+     * @brief 注册, 已登录时不能注册
+     * @param userManage 用户管理
+     * @param token 会话的凭据, 会话已失效时被清空
+     * @return QString 成功则返回空串，否则返回错误信息
+     */
+    static QString registerUser(UserManage &userManage, QJsonValue &token, const QString &username, const QString &password, const QString &name, const QString &phoneNumber, const QString &address);
+
+    /**
+     * @brief 登录, 已登录时不能登录
+     * @param userManage 用户管理
+     * @param token 会话的凭据, 会话已失效时被清空, 成功时被设置
+     * @return QString 成功则返回空串，否则返回错误信息
+     */
+    static QString login(UserManage &userManage, QJsonValue &token, const QString &username, const QString &password);
+
+    /**
+     * @brief 登出
+     * @param userManage 用户管理
+     * @param token 会话的凭据, 总是被清空
+     * @return QString 成功则返回空串，否则返回错误信息
+     */
+    static QString logout(UserManage &userManage, QJsonValue &token);
+
+    /**
+     * @brief 从快照恢复
+     * @param userManage 用户管理
+     * @param token 会话的凭据, 成功时被清空(所有用户都被登出)
+     * @param path 快照文件路径
+     * @return QString 成功则返回空串，否则返回错误信息
+     */
+    static QString restore(UserManage &userManage, QJsonValue &token, const QString &path);
+
+    /**
+     * @brief 凭据的会话已失效时清空凭据
+     * @param userManage 用户管理
+     * @param token 会话的凭据, 不为Null
+     * @note 其他会话恢复快照时清空了所有会话, 操作因此失败后应调用, 之后可以直接登录.
+     */
+    static void expireToken(const UserManage &userManage, QJsonValue &token);
+
+private:
+    /**
+     * @brief 一个操作的处理函数
+     * @note 参数依次为用户管理, 请求, 会话的凭据, 结果; 返回值同UserManage, 成功则返回空串，否则返回错误信息
+     */
+    using Handler = QString (*)(UserManage &, const QJsonObject &, QJsonValue &, QJsonValue &);
+
+    /**
+     * @brief 一个操作
+     */
+    struct Operation
+    {
+        int flags;   //OperationFlag的组合
+        Handler run; //处理函数
+    };
+
+    /**
+     * @brief 操作名到操作的表
+     */
+    static const QHash<QString, Operation> &operations();
+
+    UserManage *userManage; //用户管理
+};
+
+#endif // REQUEST_H
@@ -0,0 +1,108 @@
+﻿/**
+ * @file server.h
+ * @author Haolin Yang
+ * @brief 本地套接字服务
+ * @version 0.1
+ * @date 2022-04-10
+ *
+ * @copyright Copyright (c) 2022
+ *
+ * @note 在本地套接字上监听, 每个连接是一个会话, 每个会话有自己的登录凭据.
+ * @note 协议为一行一个Json请求, 服务按顺序一行一个Json响应, 格式见RequestHandler::handle.
+ * @note 请求在线程池中处理; 同一会话的请求按顺序逐个处理, 不同会话的请求并发处理.
+ */
+
+#ifndef SERVER_H
+#define SERVER_H
+
+#include <QLocalServer>
+#include <QLocalSocket>
+#include <QQueue>
+#include <QThreadPool>
+#include "request.h"
+
+class Server : public QObject
+{
+    Q_OBJECT
+
+public:
+    /**
+     * @brief 禁止默认的构造函数
+     * @note 用不上
+     */
+    Server() = delete;
+
+    Server(Database *_db, ItemManage *_itemManage, UserManage *_userManage, QObject *parent = nullptr);
+
+    /**
+     * @brief 开始监听
+     * @param name 本地套接字名
+     * @param threadCount 处理请求的线程数
+     * @return true 开始监听
+     * @return false 监听失败
+     * @note 已有实例在同名套接字上监听时失败; 同名的套接字文件残留时先删除.
+     * @note 纯内存存储时只使用一个线程, 见Database::isInMemory.
+     */
+    bool listen(const QString &name, int threadCount);
+
+private slots:
+    /**
+     * @brief 接受所有等待中的连接, 为每个连接创建会话
+     */
+    void acceptConnections();
+
+private:
+    QLocalServer server;    //本地套接字服务
+    Database *db;           //数据库
+    ItemManage *itemManage; //物品管理, 会话用它等待修改提交
+    RequestHandler handler; //请求处理
+    QThreadPool pool;       //处理请求的线程池, 最后声明以便最先析构, 等待处理中的请求完成
+};
+
+class Session : public QObject
+{
+    Q_OBJECT
+
+public:
+    /**
+     * @brief 禁止默认的构造函数
+     * @note 用不上
+     */
+    Session() = delete;
+
+    /**
+     * @brief 构造会话, 会话是socket的父对象
+     * @note 连接断开后会话被删除; 有请求正在处理时等处理完成再删除.
+     */
+    Session(QLocalSocket *_socket, ItemManage *_itemManage, const RequestHandler *_handler, QThreadPool *_pool, QObject *parent = nullptr);
+
+private slots:
+    /**
+     * @brief 读取所有完整的请求行并排队
+     */
+    void readRequests();
+
+    /**
+     * @brief 连接断开, 没有请求正在处理时登出会话中的用户并删除会话
+     */
+    void close();
+
+private:
+    /**
+     * @brief 没有正在处理的请求时, 将队首的请求交给线程池
+     * @note 处理完成后在会话所在线程写回响应, 并处理下一个请求.
+     * @note 连接已断开时不再处理排队的请求, 等正在处理的请求完成后删除会话.
+     */
+    void dispatchNext();
+
+    QLocalSocket *socket;           //连接
+    ItemManage *itemManage;         //物品管理
+    const RequestHandler *handler;  //请求处理
+    QThreadPool *pool;              //处理请求的线程池
+    QJsonValue token;               //会话的凭据, 未登录时为Null
+    QQueue<QByteArray> pending;     //等待处理的请求行
+    bool busy = false;              //是否有请求正在处理
+    bool closed = false;            //连接是否已断开
+};
+
+#endif // SERVER_H
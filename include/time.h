@@ -26,6 +26,8 @@ public:
     static int curMonth; //物流系统当前月
     static int curDay;   //物流系统当前日
 
+    static const int MAX_YEAR = 9999; //合法的最大年份, 保证toOrdinal不溢出
+
     Time() = default;
 
     Time(int _year, int _month, int _day) : year(_year), month(_month), day(_day){};
@@ -68,6 +70,50 @@ public:
      */
     static QString addDays(int dayNum);
 
+    /**
+     * @brief 转换为可排序的整数日期, 即自0年1月1日起的天数
+     *
+     * @return int 整数日期, 年为-1(未设置)时返回-1
+     * @note 与addDays一致, 物流系统中每月按31天计算, 因此每个时间都能与整数日期一一对应.
+     */
+    int toOrdinal() const;
+
+    /**
+     * @brief 从整数日期转换为时间
+     *
+     * @param ordinal 整数日期
+     * @return Time 时间, ordinal为负数时返回Time(-1, -1, -1)
+     */
+    static Time fromOrdinal(int ordinal);
+
+    /**
+     * @brief 从Json转换为时间, 格式与getTime相同
+     *
+     * @param json 时间信息
+     * @return Time 时间, 缺少的部分为-1, 不是整数或年大于MAX_YEAR的部分为-2(isValidPartial判为不合法)
+     */
+    static Time fromJson(const QJsonObject &json);
+
+    /**
+     * @brief 判断只给出一部分的时间中给出的部分是否合法
+     *
+     * @param partial 时间, 未给出的部分为-1
+     * @return true 年在0~MAX_YEAR之间, 月在1~12之间, 日在1~31之间
+     * @return false 某一部分超出范围
+     */
+    static bool isValidPartial(const Time &partial);
+
+    /**
+     * @brief 将只给出一部分的时间(如只有年, 或只有年和月)转换为闭区间
+     *
+     * @param partial 时间, 未给出的部分为-1
+     * @param from 返回区间下限, 年为-1时为Time(-1, -1, -1)
+     * @param to 返回区间上限, 年为-1时为Time(-1, -1, -1)
+     * @return true 转换成功
+     * @return false 给出的部分不是按年、月、日顺序的前缀, 或超出范围, 无法表示为区间
+     */
+    static bool partialToRange(const Time &partial, Time &from, Time &to);
+
     /**
      * @brief 判断某时间是否到达，以物流系统时间为判据。
      *
@@ -19,6 +19,8 @@
 #ifndef USER_H
 #define USER_H
 
+#include <QReadWriteLock>
+#include <QRecursiveMutex>
 #include "database.h"
 #include "item.h"
 #include "time.h"
@@ -197,6 +199,7 @@ public:
      * @param address 地址
      * @return QString 如果注册成功，返回空串，否则返回错误信息.
      * @note ADMINISTRATOR不用支持注册.
+     * @note 用户名是否已被注册由插入时的主键约束判断, 并发注册同一用户名只有一个成功.
      * @note register是关键字，不能作为函数名.
      */
     QString registerUser(const QString &username, const QString &password, int type, const QString &name, const QString &phoneNumber, const QString &address) const;
@@ -207,6 +210,7 @@ public:
      * @param password 密码
      * @param token 生成的凭据
      * @return QString 如果登录成功，返回空串，否则返回错误信息.
+     * @note 每次登录生成一个会话号, 同一用户的多个会话各自登出, 互不影响.
      */
     QString login(const QString &username, const QString &password, QJsonObject &token);
 
@@ -218,6 +222,15 @@ public:
      */
     QString logout(const QJsonObject &token);
 
+    /**
+     * @brief 凭据的会话是否仍然有效
+     * @param token 凭据
+     * @return true 会话仍属于凭据中的用户
+     * @return false 会话已登出, 或已被restore清空
+     * @note 与鉴权不同, 失败时不记录日志.
+     */
+    bool isLoggedIn(const QJsonObject &token) const;
+
     /**
      * @brief 更改密码
      *
@@ -325,9 +338,99 @@ public:
      *      可选："srcName" : <字符串>
      * }
      * ```
+     * @note 年、月、日可以任意给出一部分, 年应在0~9999之间, 月应在1~12之间, 日应在1~31之间. 按年、年月或年月日给出的部分转换为日期区间,
+     * @note 其余的月、日(如只给出月, 或给出年和日)按相等单独比较, 用不上索引.
+     * @note 三种格式都可以另外给出日期区间(闭区间), 覆盖上面由年、月、日得到的区间:
+     * ```json
+     * {
+     *      可选："sendingTime_From" : {"year": <整数>, "month": <整数>, "day": <整数>},
+     *      可选："sendingTime_To" : {"year": <整数>, "month": <整数>, "day": <整数>},
+     *      可选："receivingTime_From" : {"year": <整数>, "month": <整数>, "day": <整数>},
+     *      可选："receivingTime_To" : {"year": <整数>, "month": <整数>, "day": <整数>}
+     * }
+     * ```
+     * @note 区间的端点可以只给出年或年月, 起始日期取其中最早的一天, 截止日期取其中最晚的一天.
+     * @note 三种格式都可以按单号分页, 给出其中任意一个键时结果按单号排序:
+     * ```json
+     * {
+     *      可选："after_id" : <整数>, 上一页最后一个物品的单号, 不给出则从第一页开始
+     *      可选："limit" : <正整数>, 每页最多返回的物品数
+     *      可选："desc" : <布尔>, 为true时按单号从大到小(从新到旧)排列
+     * }
+     * ```
      */
     QString queryItem(const QJsonObject &token, const QJsonObject &filter, QJsonArray &ret) const;
 
+    /**
+     * @brief 按照条件逐个查询商品，每查到一个就交给visitor处理，不保存结果。
+     * @param token 用户鉴权
+     * @param filter 条件, 格式与上面的queryItem相同
+     * @param visitor 处理一个商品的函数, 商品格式与上面的queryItem的结果相同
+     * @return QString 查询成功则返回空串，否则返回错误信息
+     */
+    QString queryItem(const QJsonObject &token, const QJsonObject &filter, const std::function<void(const QJsonObject &)> &visitor) const;
+
+    /**
+     * @brief 统计符合条件的商品数量，不读取商品信息。
+     * @param token 用户鉴权
+     * @param filter 条件, 格式与queryItem相同, 分页的键中只有after_id生效
+     * @param ret 符合条件的数量
+     * @return QString 成功则返回空串，否则返回错误信息
+     */
+    QString countItem(const QJsonObject &token, const QJsonObject &filter, int &ret) const;
+
+    /**
+     * @brief 按条件分组统计商品数量和收入(花费总和)。
+     * @param token 用户鉴权
+     * @param filter 条件, 格式与queryItem相同, 分页的键不生效; 另外用"groupBy"键给出分组的列
+     * @param ret 统计结果, 每个分组一个Json对象
+     * @return QString 成功则返回空串，否则返回错误信息
+     * @note 仅限管理员使用. 条件和结果格式:
+     * ```json
+     * 条件: {
+     *      "type": 0,
+     *      可选："groupBy" : [ "srcName" | "state" | "sendingTime" ...], 不给出时只有一行总计
+     *      ...其余条件同queryItem
+     * }
+     * 结果的每一项: {
+     *      "count" : <整数>,
+     *      "revenue" : <整数>,
+     *      按寄件用户分组时："srcName" : <字符串>,
+     *      按物品状态分组时："state" : <整数>,
+     *      按寄送日期分组时："sendingTime_Year" : <整数>, "sendingTime_Month" : <整数>, "sendingTime_Day" : <整数>
+     * }
+     * ```
+     */
+    QString aggregateItem(const QJsonObject &token, const QJsonObject &filter, QJsonArray &ret) const;
+
+    /**
+     * @brief 获得queryItem在相同条件下使用的查询计划
+     * @param token 凭据
+     * @param filter 条件, 格式与queryItem相同
+     * @param ret 查询计划的每一行
+     * @return QString 成功则返回空串，否则返回错误信息
+     * @note 仅限管理员使用, 用于确认各种查询都能用上索引.
+     */
+    QString explainItemQuery(const QJsonObject &token, const QJsonObject &filter, QStringList &ret) const;
+
+    /**
+     * @brief 将用户和物品数据保存为快照文件
+     * @param token 凭据
+     * @param path 快照文件路径
+     * @return QString 成功则返回空串，否则返回错误信息
+     * @note 仅限管理员使用.
+     */
+    QString snapshot(const QJsonObject &token, const QString &path) const;
+
+    /**
+     * @brief 用快照文件替换全部用户和物品数据
+     * @param token 凭据
+     * @param path 快照文件路径
+     * @return QString 成功则返回空串，否则返回错误信息
+     * @note 仅限管理员使用. 恢复成功后所有用户都被登出.
+     */
+    QString restore(const QJsonObject &token, const QString &path);
+
     /**
      * @brief 发送快递物品
      * @param token 凭据
@@ -359,16 +462,49 @@ public:
 
 private:
     QMap<QString, QSharedPointer<User>> userMap; //用户名到用户对象的映射.
+    QHash<int, QString> sessions;                //会话号到用户名的映射
+    QHash<QString, int> sessionCount;            //用户名到已登录会话数的映射, 为0时释放用户对象
+    int lastSession = 0;                         //最后生成的会话号
     Database *db;                                //数据库
     ItemManage *itemManage;                      //物品管理类
+    mutable QReadWriteLock userLock;             //保护userMap和会话, 登录、登出时写, 鉴权时读
+    mutable QRecursiveMutex balanceMutex;        //保护已登录用户的余额, 余额的检查和修改在同一次加锁中完成; 必须在开始数据库事务前获取
 
     /**
      * @brief 用户鉴权
      * @param token 凭据
+     * @param user 不为空时用于返回用户对象
      * @return QString 鉴权成功则返回用户名，失败则返回空串.
      * @note 空串可用isEmpty判断.
+     * @note 返回的用户对象在其他会话登出该用户后仍然有效, 不要再通过userMap访问.
+     */
+    QString verify(const QJsonObject &token, QSharedPointer<User> *user = nullptr) const;
+
+    /**
+     * @brief 将物品转换为Json, 格式见queryItem
+     * @param item 物品
+     * @return QJsonObject 物品信息
+     */
+    static QJsonObject item2Json(const Item &item);
+
+    /**
+     * @brief 将Json格式的查询条件解析为ItemManage::queryByFilter的查询条件
+     * @param token 凭据
+     * @param filter 条件, 格式见queryItem
+     * @return QString 解析成功则返回空串，否则返回错误信息
+     * @note type为1或2时, 寄件人或收件人会被替换为当前用户.
      */
-    QString verify(const QJsonObject &token) const;
+    QString parseItemFilter(const QJsonObject &token, const QJsonObject &filter, ItemFilter &ret) const;
+
+    /**
+     * @brief 将只给出一部分的时间拆分为日期区间和单独的月、日条件
+     * @param partial 时间, 未给出的部分为-1, 各部分已检查过范围
+     * @param from 返回按年、年月或年月日的前缀得到的区间下限
+     * @param to 返回区间上限
+     * @param month 返回不给出年时的月, 否则为-1
+     * @param day 返回不能并入区间的日, 否则为-1
+     */
+    static void splitPartialTime(const Time &partial, Time &from, Time &to, int &month, int &day);
 
     /**
      * @brief 转钱: 减少一个用户的余额，增加另一个用户的余额。
@@ -377,8 +513,26 @@ private:
      * @param srcUser 第二个用户（加上转移余额量的用户）的用户名
      * @return QString 转钱成功，返回空串，否则返回错误信息.
      * @note 转移余额量可以为负
+     * @note 两个用户的余额在同一个数据库事务中修改.
      */
     QString transferBalance(const QJsonObject &token, int balance, const QString &dstUser) const;
+
+    /**
+     * @brief 检查转账后两个用户的余额是否合法, 调用者应持有balanceMutex
+     * @param user 转出的用户
+     * @param balance 转移余额量
+     * @param dstUser 转入的用户名
+     * @return QString 合法返回空串，否则返回错误信息.
+     */
+    QString checkTransfer(const QSharedPointer<User> &user, int balance, const QString &dstUser) const;
+
+    /**
+     * @brief 同步已登录用户对象中缓存的余额
+     * @param username 用户名
+     * @param addend 余额增量
+     * @note 用户未登录时什么都不做.
+     */
+    void applyBalance(const QString &username, int addend) const;
 };
 
 #endif
\ No newline at end of file
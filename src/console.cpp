@@ -0,0 +1,578 @@
+﻿/**
+ * @file console.cpp
+ * @author Haolin Yang
+ * @brief 命令行指令的解析、分发和结果输出的实现
+ * @version 0.1
+ * @date 2022-04-10
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+
+#include "../include/console.h"
+
+namespace
+{
+    const QVector<QString> userType{"CUSTOMER", "ADMINISTRATOR"};
+    const QVector<QString> itemState{"", "已签收", "待签收"};
+    const QString BAD_COMMAND = "指令输入有误，请输入help查看帮助";
+
+    /**
+     * @brief 把物品中的一个时间格式化为 年/月/日
+     * @param prefix 时间的键前缀, 如"sendingTime"
+     */
+    QString formatDate(const QJsonObject &object, const QString &prefix)
+    {
+        return QString("%1/%2/%3").arg(object[prefix + "_Year"].toInt()).arg(object[prefix + "_Month"].toInt()).arg(object[prefix + "_Day"].toInt());
+    }
+}
+
+void Renderer::fail(const QString &text)
+{
+    failed = true;
+    Logger::writeResult(text);
+}
+
+void Renderer::message(const QString &text)
+{
+    Logger::writeResult(text);
+}
+
+void Renderer::item(const QJsonObject &item)
+{
+    Logger::writeResult(QStringList{"物品单号为", QString::number(item["id"].toInt()), "花费为", QString::number(item["cost"].toInt()), "状态为", itemState.value(item["state"].toInt()),
+                                    "寄送时间为", formatDate(item, "sendingTime"), "接收时间为", formatDate(item, "receivingTime"),
+                                    "寄件人为", item["srcName"].toString(), "收件人为", item["dstName"].toString(), "描述为", item["description"].toString()}
+                            .join(' '));
+}
+
+void Renderer::user(const QJsonObject &user)
+{
+    Logger::writeResult(QStringList{"用户名为", user["username"].toString(),
+                                    "类型为", userType.value(user["type"].toInt()),
+                                    "余额为", QString::number(user["balance"].toInt()),
+                                    "姓名为", user["name"].toString(),
+                                    "电话为", user["phonenumber"].toString(),
+                                    "住址为", user["address"].toString()}
+                            .join(' '));
+}
+
+void Renderer::stat(const QJsonObject &row)
+{
+    QString group;
+    if (row.contains("srcName"))
+        group += " 寄件人为 " + row["srcName"].toString();
+    if (row.contains("state"))
+        group += " 状态为 " + itemState.value(row["state"].toInt());
+    if (row.contains("sendingTime_Year"))
+        group += " 寄送时间为 " + formatDate(row, "sendingTime");
+    Logger::writeResult(QString("%1 数量为 %2 收入为 %3").arg(group.isEmpty() ? "全部" : group.trimmed()).arg(row["count"].toInt()).arg(row["revenue"].toVariant().toLongLong()));
+}
+
+const QVector<Console::Command> &Console::commandList()
+{
+    //query/querysrc/querydst的前7个参数: 物品单号, 寄送时间年月日, 接收时间年月日
+    const QVector<ArgType> itemArgs(7, ARG_INT_OR_ANY);
+    static const QVector<Command> list{
+        {"help", {}, false, 0, &Console::help, "", "", {}},
+        {"time", {}, false, 0, &Console::time, "系统时间", "time", {}},
+        {"addtime", {ARG_INT}, false, 0, &Console::addTime, "加快系统时间", "addtime <天数>", {}},
+        {"register", {ARG_STRING, ARG_STRING, ARG_STRING, ARG_STRING, ARG_STRING}, false, MUTATING, &Console::registerUser, "注册", "register <用户名> <密码> <姓名> <电话号码> <地址>", {}},
+        {"login", {ARG_STRING, ARG_STRING}, false, 0, &Console::login, "登录", "login <用户名> <密码>", {}},
+        {"logout", {}, false, NEED_LOGIN, &Console::logout, "登出", "logout", {}},
+        {"changepassword", {ARG_STRING}, false, NEED_LOGIN | MUTATING, &Console::changePassword, "修改密码", "changepassword <新密码>", {}},
+        {"info", {}, false, NEED_LOGIN, &Console::info, "查看个人信息", "info", {}},
+        {"alluserinfo", {}, false, NEED_LOGIN, &Console::allUserInfo, "查看所有用户信息", "alluserinfo", {"注意此功能仅限管理员使用。"}},
+        {"addbalance", {ARG_INT}, false, NEED_LOGIN | MUTATING, &Console::addBalance, "充值", "addbalance <增加量>", {}},
+        {"queryallitem", {}, false, NEED_LOGIN, &Console::queryAllItem, "查询所有快递", "queryallitem", {"注意此功能仅限管理员使用。"}},
+        {"query", itemArgs + QVector<ArgType>{ARG_STRING_OR_ANY, ARG_STRING_OR_ANY}, false, NEED_LOGIN, &Console::query, "查询所有符合条件的快递",
+         "query <物品单号> <寄送时间年> <寄送时间月> <寄送时间日> <接收时间年> <接收时间月> <接收时间日> <寄件用户的用户名> <收件用户的用户名>",
+         {"若要查询所有符合该条件的物品，则该条件用*代替。注意此功能仅限管理员使用。"}},
+        {"querysrc", itemArgs + QVector<ArgType>{ARG_STRING_OR_ANY}, false, NEED_LOGIN, &Console::querySrc, "查找发出的符合条件的快递",
+         "querysrc <物品单号> <寄送时间年> <寄送时间月> <寄送时间日> <接收时间年> <接收时间月> <接收时间日> <收件用户的用户名>",
+         {"若要查询所有符合该条件的物品，则该条件用*代替。若要查询全部，可以只输入querysrc。"}},
+        {"querysrc", {}, false, NEED_LOGIN, &Console::querySrc, "", "", {}},
+        {"querydst", itemArgs + QVector<ArgType>{ARG_STRING_OR_ANY}, false, NEED_LOGIN, &Console::queryDst, "查找将收到的符合条件的快递",
+         "querydst <物品单号> <寄送时间年> <寄送时间月> <寄送时间日> <接收时间年> <接收时间月> <接收时间日> <寄件用户的用户名>",
+         {"若要查询所有符合该条件的物品，则该条件用*代替。若要查询全部，可以只输入querydst。"}},
+        {"querydst", {}, false, NEED_LOGIN, &Console::queryDst, "", "", {}},
+        {"queryrange", {ARG_DATE_OR_ANY, ARG_DATE_OR_ANY, ARG_DATE_OR_ANY, ARG_DATE_OR_ANY}, false, NEED_LOGIN, &Console::queryRange, "按日期区间查询快递",
+         "queryrange <寄送起始日期> <寄送截止日期> <接收起始日期> <接收截止日期>",
+         {"日期格式为 年/月/日，区间包含两端，不限制的一端用*代替。注意此功能仅限管理员使用。"}},
+        {"stats", {}, true, NEED_LOGIN, &Console::stats, "分组统计快递数量和收入", "stats [user] [state] [date]",
+         {"可按寄件用户、状态、寄送日期的任意组合分组，不加参数时统计全部。注意此功能仅限管理员使用。"}},
+        {"cachestats", {}, false, 0, &Console::cacheStats, "查看物品缓存命中情况", "cachestats", {}},
+        {"count", {}, false, NEED_LOGIN, &Console::count, "统计快递数量", "count", {"管理员统计所有快递，用户统计发出和将收到的快递。"}},
+        {"pagesize", {ARG_INT}, false, 0, &Console::pageSizeCommand, "设置查询结果分页", "pagesize <每页数量> [desc]", {"每页数量为0时不分页。加上desc时从新到旧显示。"}},
+        {"pagesize", {ARG_INT, ARG_STRING}, false, 0, &Console::pageSizeCommand, "", "", {}},
+        {"next", {}, false, NEED_LOGIN, &Console::next, "查看下一页查询结果", "next", {}},
+        {"snapshot", {ARG_STRING}, false, NEED_LOGIN | NO_TRANSACTION, &Console::snapshot, "保存快照", "snapshot <文件路径>", {}},
+        {"restore", {ARG_STRING}, false, NEED_LOGIN | NO_TRANSACTION, &Console::restore, "从快照恢复", "restore <文件路径>", {"恢复后所有用户都会被登出。注意这两个功能仅限管理员使用。"}},
+        {"explain", {}, false, NEED_LOGIN, &Console::explain, "查看各类物品查询的查询计划", "explain", {"注意此功能仅限管理员使用。"}},
+        {"send", {ARG_STRING, ARG_STRING}, false, NEED_LOGIN | MUTATING, &Console::send, "发送快递", "send <收件用户的用户名> <描述>", {}},
+        {"receive", {ARG_INT}, false, NEED_LOGIN | MUTATING, &Console::receive, "接收快递", "receive <物品单号>", {}},
+        {"exit", {}, false, 0, nullptr, "退出系统", "exit", {}}};
+    return list;
+}
+
+const QHash<QString, QVector<const Console::Command *>> &Console::commandTable()
+{
+    static const QHash<QString, QVector<const Command *>> table = []()
+    {
+        QHash<QString, QVector<const Command *>> ret;
+        for (const Command &command : commandList())
+            ret[command.verb].append(&command);
+        return ret;
+    }();
+    return table;
+}
+
+QString Console::parseArgs(const Command &command, const QStringList &words, Args &ret)
+{
+    ret.clear();
+    ret.reserve(words.size());
+    for (int i = 0; i < words.size(); i++)
+    {
+        const QString &word = words[i];
+        ArgType type = i < command.args.size() ? command.args[i] : ARG_STRING;
+        if (word == "*" && (type == ARG_INT_OR_ANY || type == ARG_STRING_OR_ANY || type == ARG_DATE_OR_ANY))
+        {
+            ret.append(QVariant());
+            continue;
+        }
+        bool ok = true;
+        switch (type)
+        {
+        case ARG_INT:
+        case ARG_INT_OR_ANY:
+            ret.append(word.toInt(&ok));
+            if (!ok)
+                return QString("第%1个参数应为整数").arg(i + 1);
+            break;
+        case ARG_STRING:
+        case ARG_STRING_OR_ANY:
+            ret.append(word);
+            break;
+        case ARG_DATE_OR_ANY:
+        {
+            QStringList date = word.split('/');
+            bool yearOk = false, monthOk = false, dayOk = false;
+            if (date.size() == 3)
+                ret.append(QJsonObject{{"year", date[0].toInt(&yearOk)}, {"month", date[1].toInt(&monthOk)}, {"day", date[2].toInt(&dayOk)}});
+            if (!yearOk || !monthOk || !dayOk)
+                return QString("第%1个参数应为 年/月/日").arg(i + 1);
+            break;
+        }
+        }
+    }
+    return {};
+}
+
+bool Console::execute(const QString &line)
+{
+    QString trimmed = line.trimmed();
+    if (trimmed.isEmpty())
+        return true;
+    commandCount++;
+
+    if (trimmed.startsWith('{'))
+    {
+        if (!dispatchJson(trimmed))
+            failureCount++;
+        return true;
+    }
+
+    QStringList words = trimmed.split(' ', Qt::SkipEmptyParts);
+    QString verb = words.takeFirst().toLower();
+    Renderer out;
+    bool ret = dispatch(verb, words, out);
+    if (out.hasFailed())
+        failureCount++;
+    return ret;
+}
+
+bool Console::dispatchJson(const QString &line)
+{
+    QJsonParseError error;
+    QJsonDocument document = QJsonDocument::fromJson(line.toUtf8(), &error);
+    QJsonObject response;
+    if (!document.isObject())
+        response = QJsonObject{{"ok", false}, {"error", "请求不是Json对象 " + error.errorString()}};
+    else
+    {
+        QJsonObject request = document.object();
+        bool grouped = prepareGroup(RequestHandler::getFlags(request["op"].toString()));
+        response = handler.handle(request, token);
+        if (grouped && response["ok"].toBool())
+            groupSize++;
+        //登出或恢复快照后分页条件作废
+        if (token.isNull())
+            pageFilter = QJsonObject();
+    }
+    Logger::writeResult(QString::fromUtf8(QJsonDocument(response).toJson(QJsonDocument::Compact)));
+    return response["ok"].toBool();
+}
+
+bool Console::dispatch(const QString &verb, const QStringList &words, Renderer &out)
+{
+    //同名指令的各种格式按参数个数区分, 参数个数相同时取第一个能解析的
+    const Command *command = nullptr;
+    Args args;
+    QString error = BAD_COMMAND;
+    for (const Command *candidate : commandTable().value(verb))
+    {
+        if (words.size() < candidate->args.size() || (words.size() > candidate->args.size() && !candidate->variadic))
+            continue;
+        error = parseArgs(*candidate, words, args);
+        if (error.isEmpty())
+        {
+            command = candidate;
+            break;
+        }
+    }
+    if (!command)
+    {
+        out.fail(error);
+        return true;
+    }
+    if (!command->run)
+        return false;
+    //提交失败时会登出, 先提交再检查是否登录
+    bool grouped = prepareGroup(command->flags);
+    if (command->flags & NEED_LOGIN && token.isNull())
+    {
+        out.fail(RequestHandler::NOT_LOGGED_IN);
+        return true;
+    }
+    (this->*command->run)(args, out);
+    //失败的指令已经计数, 事务提交失败时只需补计成功的指令
+    if (grouped && !out.hasFailed())
+        groupSize++;
+    return true;
+}
+
+bool Console::prepareGroup(int flags)
+{
+    if (!batch)
+        return false;
+    bool mutating = flags & MUTATING;
+    if (inGroup && ((flags & NO_TRANSACTION) || (mutating && groupSize >= BATCH_GROUP_SIZE)))
+        finish();
+    if (mutating && !inGroup)
+    {
+        inGroup = db->beginTransaction();
+        groupSize = 0;
+    }
+    return mutating && inGroup;
+}
+
+bool Console::check(const QString &ret, const QString &prefix, Renderer &out)
+{
+    if (ret.isEmpty())
+        return true;
+    out.fail(prefix + ret);
+    //与RequestHandler::handle相同: 因会话失效而失败时回到未登录状态
+    if (!token.isNull())
+        RequestHandler::expireToken(*userManage, token);
+    if (token.isNull())
+        pageFilter = QJsonObject();
+    return false;
+}
+
+bool Console::finish()
+{
+    if (!inGroup)
+        return true;
+    inGroup = false;
+    if (db->commitTransaction())
+        return true;
+    //事务中的修改全部丢失
+    db->rollbackTransaction();
+    failureCount += groupSize;
+    qCritical().noquote() << QString("数据库提交失败，之前的%1条修改已丢失").arg(groupSize);
+    //已登录用户的余额可能含有丢失的修改，登出后重新登录才能从数据库读取
+    if (!token.isNull())
+    {
+        RequestHandler::logout(*userManage, token);
+        pageFilter = QJsonObject();
+        qCritical() << "已登出";
+    }
+    return false;
+}
+
+QJsonObject Console::itemFilter(int type, const Args &args, const QStringList &nameKeys)
+{
+    static const char *const keys[] = {"id", "sendingTime_Year", "sendingTime_Month", "sendingTime_Day", "receivingTime_Year", "receivingTime_Month", "receivingTime_Day"};
+    QJsonObject filter;
+    filter.insert("type", type);
+    for (int i = 0; i < args.size(); i++)
+    {
+        if (!args[i].isValid())
+            continue;
+        if (i < 7)
+            filter.insert(keys[i], args[i].toInt());
+        else
+            filter.insert(nameKeys[i - 7], args[i].toString());
+    }
+    return filter;
+}
+
+void Console::runQuery(QJsonObject filter, Renderer &out)
+{
+    if (pageSize > 0)
+    {
+        filter.insert("limit", pageSize);
+        filter.insert("desc", pageDesc);
+    }
+    pageCount = 0;
+    //查询结果逐条输出，不在内存中保存整个结果集
+    QString ret = userManage->queryItem(token.toObject(), filter, [this, &out](const QJsonObject &item)
+                                        {
+                                            pageLastId = item["id"].toInt();
+                                            pageCount++;
+                                            out.item(item);
+                                        });
+    if (check(ret, "查询失败 ", out) && pageSize > 0 && pageCount == pageSize)
+    {
+        pageFilter = filter;
+        out.message("输入 next 查看下一页");
+    }
+    else
+        pageFilter = QJsonObject();
+}
+
+void Console::help(const Args &, Renderer &out)
+{
+    for (const Command &command : commandList())
+    {
+        if (command.description.isEmpty())
+            continue;
+        out.message(command.description + ": " + command.usage);
+        for (const QString &note : command.notes)
+            out.message("    " + note);
+    }
+    out.message("批量执行指令: main batch [指令文件]");
+    out.message("    不给出文件时从标准输入读取，只输出结果，结束时输出执行速度和失败数。");
+    out.message("以服务方式启动: main server [套接字名] [线程数]");
+    out.message("    每个连接是一个会话，一行一个Json请求，见request.h。");
+    out.message("每行指令也可以是Json请求，格式与服务方式相同，响应以一行Json输出。");
+}
+
+void Console::time(const Args &, Renderer &out)
+{
+    QJsonObject retInfo;
+    if (check(Time::getTime(retInfo), "查询物流系统时间失败 ", out))
+        out.message(QString("查询物流系统时间成功，当前时间为 %1/%2/%3").arg(retInfo["year"].toInt()).arg(retInfo["month"].toInt()).arg(retInfo["day"].toInt()));
+}
+
+void Console::addTime(const Args &args, Renderer &out)
+{
+    QString ret = Time::addDays(args[0].toInt());
+    if (ret.isEmpty())
+        out.message("物流系统时间增加成功。");
+    else
+        out.fail("物流系统时间增加失败 " + ret);
+}
+
+void Console::registerUser(const Args &args, Renderer &out)
+{
+    QString ret = RequestHandler::registerUser(*userManage, token, args[0].toString(), args[1].toString(), args[2].toString(), args[3].toString(), args[4].toString());
+    if (check(ret, "用户 " + args[0].toString() + " 注册失败 ", out))
+        out.message("用户 " + args[0].toString() + " 注册成功");
+}
+
+void Console::login(const Args &args, Renderer &out)
+{
+    if (check(RequestHandler::login(*userManage, token, args[0].toString(), args[1].toString()), "用户 " + args[0].toString() + " 登录失败 ", out))
+        out.message("用户 " + args[0].toString() + " 登录成功");
+}
+
+void Console::logout(const Args &, Renderer &out)
+{
+    if (check(RequestHandler::logout(*userManage, token), "登出失败 ", out))
+        out.message("已登出");
+    pageFilter = QJsonObject();
+}
+
+void Console::changePassword(const Args &args, Renderer &out)
+{
+    if (check(userManage->changePassword(token.toObject(), args[0].toString()), "修改密码失败 ", out))
+        out.message("修改密码成功");
+}
+
+void Console::info(const Args &, Renderer &out)
+{
+    QJsonObject retInfo;
+    if (check(userManage->getUserInfo(token.toObject(), retInfo), "查询用户信息失败 ", out))
+        out.user(retInfo);
+}
+
+void Console::allUserInfo(const Args &, Renderer &out)
+{
+    QJsonArray queryRet;
+    if (!check(userManage->queryAllUserInfo(token.toObject(), queryRet), "查询失败 ", out))
+        return;
+    out.message("查询成功");
+    for (const auto &i : queryRet)
+        out.user(i.toObject());
+}
+
+void Console::addBalance(const Args &args, Renderer &out)
+{
+    if (check(userManage->addBalance(token.toObject(), args[0].toInt()), "余额充值失败 ", out))
+        out.message("余额充值成功");
+}
+
+void Console::queryAllItem(const Args &, Renderer &out)
+{
+    runQuery(itemFilter(0, {}, {}), out);
+}
+
+void Console::query(const Args &args, Renderer &out)
+{
+    runQuery(itemFilter(0, args, {"srcName", "dstName"}), out);
+}
+
+void Console::querySrc(const Args &args, Renderer &out)
+{
+    runQuery(itemFilter(1, args, {"dstName"}), out);
+}
+
+void Console::queryDst(const Args &args, Renderer &out)
+{
+    runQuery(itemFilter(2, args, {"srcName"}), out);
+}
+
+void Console::queryRange(const Args &args, Renderer &out)
+{
+    static const char *const keys[] = {"sendingTime_From", "sendingTime_To", "receivingTime_From", "receivingTime_To"};
+    QJsonObject filter;
+    filter.insert("type", 0);
+    for (int i = 0; i < 4; i++)
+        if (args[i].isValid())
+            filter.insert(keys[i], args[i].toJsonObject());
+    runQuery(filter, out);
+}
+
+void Console::explain(const Args &, Renderer &out)
+{
+    //query/querysrc/querydst常见的条件组合，只有哪些条件生效影响查询计划
+    static const QVector<QPair<QString, QJsonObject>> shapes{
+        {"query", QJsonObject{{"type", 0}}},
+        {"query <单号>", QJsonObject{{"type", 0}, {"id", 1}}},
+        {"query <寄送日期>", QJsonObject{{"type", 0}, {"sendingTime_Year", 1}, {"sendingTime_Month", 1}, {"sendingTime_Day", 1}}},
+        {"query <接收日期>", QJsonObject{{"type", 0}, {"receivingTime_Year", 1}, {"receivingTime_Month", 1}, {"receivingTime_Day", 1}}},
+        {"queryrange <寄送起始日期> *", QJsonObject{{"type", 0}, {"sendingTime_From", QJsonObject{{"year", 1}}}}},
+        {"queryrange * * <接收起始日期> <接收截止日期>", QJsonObject{{"type", 0}, {"receivingTime_From", QJsonObject{{"year", 1}}}, {"receivingTime_To", QJsonObject{{"year", 1}}}}},
+        {"query <寄件人>", QJsonObject{{"type", 0}, {"srcName", "admin"}}},
+        {"query <收件人>", QJsonObject{{"type", 0}, {"dstName", "admin"}}},
+        {"querysrc", QJsonObject{{"type", 1}}},
+        {"querysrc <寄送年月>", QJsonObject{{"type", 1}, {"sendingTime_Year", 1}, {"sendingTime_Month", 1}}},
+        {"querysrc * <寄送月>", QJsonObject{{"type", 1}, {"sendingTime_Month", 1}}},
+        {"querysrc <收件人>", QJsonObject{{"type", 1}, {"dstName", "admin"}}},
+        {"querysrc 下一页", QJsonObject{{"type", 1}, {"after_id", 1}, {"limit", 1}}},
+        {"querydst", QJsonObject{{"type", 2}}},
+        {"querydst 下一页", QJsonObject{{"type", 2}, {"after_id", 1}, {"limit", 1}}},
+        {"querydst 下一页(倒序)", QJsonObject{{"type", 2}, {"after_id", 1}, {"limit", 1}, {"desc", true}}},
+        {"querydst <寄送日期>", QJsonObject{{"type", 2}, {"sendingTime_Year", 1}, {"sendingTime_Month", 1}, {"sendingTime_Day", 1}}},
+        {"querydst <寄件人>", QJsonObject{{"type", 2}, {"srcName", "admin"}}}};
+    for (const auto &shape : shapes)
+    {
+        QStringList plan;
+        if (!check(userManage->explainItemQuery(token.toObject(), shape.second, plan), "查询失败 ", out))
+            return;
+        out.message(shape.first + " : " + plan.join("; "));
+    }
+}
+
+void Console::send(const Args &args, Renderer &out)
+{
+    if (check(userManage->sendItem(token.toObject(), QJsonObject{{"dstName", args[0].toString()}, {"description", args[1].toString()}}), "物品添加失败 ", out))
+        out.message("物品添加成功");
+}
+
+void Console::receive(const Args &args, Renderer &out)
+{
+    if (check(userManage->receiveItem(token.toObject(), QJsonObject{{"id", args[0].toInt()}}), "物品接收失败 ", out))
+        out.message("物品接收成功");
+}
+
+void Console::snapshot(const Args &args, Renderer &out)
+{
+    if (check(userManage->snapshot(token.toObject(), args[0].toString()), "快照保存失败 ", out))
+        out.message("快照保存成功");
+}
+
+void Console::restore(const Args &args, Renderer &out)
+{
+    if (check(RequestHandler::restore(*userManage, token, args[0].toString()), "快照恢复失败 ", out))
+    {
+        pageFilter = QJsonObject();
+        out.message("快照恢复成功，请重新登录");
+    }
+}
+
+void Console::stats(const Args &args, Renderer &out)
+{
+    static const QHash<QString, QString> groupNames{{"user", "srcName"}, {"state", "state"}, {"date", "sendingTime"}};
+    QJsonArray groupBy;
+    for (const QVariant &arg : args)
+        groupBy.append(groupNames.value(arg.toString(), arg.toString()));
+    QJsonObject filter;
+    filter.insert("type", 0);
+    filter.insert("groupBy", groupBy);
+    QJsonArray statsRet;
+    if (!check(userManage->aggregateItem(token.toObject(), filter, statsRet), "统计失败 ", out))
+        return;
+    for (const auto &i : statsRet)
+        out.stat(i.toObject());
+}
+
+void Console::cacheStats(const Args &, Renderer &out)
+{
+    out.message(QString("物品缓存命中%1次，未命中%2次").arg(itemManage->getCacheHits()).arg(itemManage->getCacheMisses()));
+}
+
+void Console::count(const Args &, Renderer &out)
+{
+    QJsonObject retInfo;
+    if (!check(userManage->getUserInfo(token.toObject(), retInfo), "统计失败 ", out))
+        return;
+    //管理员统计全部(type 0)，用户分别统计发出(type 1)和将收到(type 2)的快递
+    QVector<int> types = retInfo["type"].toInt() == ADMINISTRATOR ? QVector<int>{0} : QVector<int>{1, 2};
+    static const QVector<QString> typeName{"所有快递", "发出的快递", "将收到的快递"};
+    for (int type : types)
+    {
+        int cnt = 0;
+        if (check(userManage->countItem(token.toObject(), QJsonObject{{"type", type}}, cnt), "统计失败 ", out))
+            out.message(QString("%1共%2件").arg(typeName[type]).arg(cnt));
+    }
+}
+
+void Console::pageSizeCommand(const Args &args, Renderer &out)
+{
+    if (args[0].toInt() < 0 || (args.size() == 2 && args[1].toString() != "desc"))
+    {
+        out.fail(BAD_COMMAND);
+        return;
+    }
+    pageSize = args[0].toInt();
+    pageDesc = args.size() == 2;
+    pageFilter = QJsonObject();
+    if (pageSize > 0)
+        out.message(QString("查询结果每页显示%1条").arg(pageSize));
+    else
+        out.message("查询结果不再分页");
+}
+
+void Console::next(const Args &, Renderer &out)
+{
+    if (pageFilter.isEmpty())
+    {
+        out.fail("没有下一页。");
+        return;
+    }
+    QJsonObject filter = pageFilter;
+    filter.insert("after_id", pageLastId);
+    runQuery(filter, out);
+}
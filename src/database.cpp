@@ -10,70 +10,430 @@
  */
 
 #include "../include/database.h"
+#include "../include/logger.h"
 #include <QDebug>
 #include <QDir>
 
 using namespace std;
 
-void Database::exec(const QSqlQuery &sqlQuery)
+Q_LOGGING_CATEGORY(sqlTrace, "database.sql", QtInfoMsg)
+
+const int MAX_RESERVE_ROWS = 1024; //按limit预先分配结果空间时最多预留的行数，更多的行随读取增长
+
+QAtomicInt Database::traceSampleInterval(0);
+QAtomicInt Database::traceCounter(0);
+
+void Database::setTraceSampling(int interval)
+{
+    traceSampleInterval.storeRelaxed(interval > 0 ? interval : 0);
+}
+
+bool Database::exec(QSqlQuery &sqlQuery)
 {
-    qDebug() << "执行SQL语句" << sqlQuery.lastQuery();
-    QMap<QString, QVariant> sqlIter(sqlQuery.boundValues());
-    for (auto i = sqlIter.begin(); i != sqlIter.end(); i++)
-        qDebug() << i.key().toUtf8().data() << ":" << i.value().toString().toUtf8().data();
+#ifdef DATABASE_SQL_TRACE
+    //逐条跟踪: QT_LOGGING_RULES="database.sql.debug=true"
+    if (Q_UNLIKELY(sqlTrace().isDebugEnabled()))
+    {
+        qCDebug(sqlTrace) << "执行SQL语句" << sqlQuery.lastQuery();
+        QMap<QString, QVariant> sqlIter(sqlQuery.boundValues());
+        for (auto i = sqlIter.begin(); i != sqlIter.end(); i++)
+            qCDebug(sqlTrace) << i.key().toUtf8().data() << ":" << i.value().toString().toUtf8().data();
+    }
+
+    //采样跟踪: 每traceSampleInterval条语句记录一条及其耗时
+    int interval = traceSampleInterval.loadRelaxed();
+    if (Q_UNLIKELY(interval > 0) && traceCounter.fetchAndAddRelaxed(1) % interval == 0)
+    {
+        QElapsedTimer timer;
+        timer.start();
+        bool flag = sqlQuery.exec();
+        qCInfo(sqlTrace) << "SQL采样" << sqlQuery.lastQuery() << "耗时" << timer.nsecsElapsed() / 1000 << "us";
+        return flag;
+    }
+#endif
+    return sqlQuery.exec();
+}
+
+QSqlQuery &Database::prepareCached(const QString &statement) const
+{
+    Connection &conn = connection();
+    QSharedPointer<QSqlQuery> &cached = conn.statementCache[statement];
+    if (!cached)
+    {
+        cached = QSharedPointer<QSqlQuery>::create(conn.db);
+        cached->setForwardOnly(true);
+        if (!cached->prepare(statement))
+            qCritical() << "数据库:预编译" << statement << "失败" << cached->lastError();
+    }
+    return *cached;
+}
+
+bool Database::execStatement(const QString &statement) const
+{
+    QSqlQuery &sqlQuery = prepareCached(statement);
+    if (!exec(sqlQuery))
+    {
+        qCritical() << "数据库:执行" << statement << "失败" << sqlQuery.lastError();
+        return false;
+    }
+    return true;
 }
 
 const QString &Database::getPrimaryKeyByTableName(const QString &tableName)
 {
-    // static QString username("username");
+    static QString username("username");
     static QString id("id");
-    // if (tableName == "user")
-    //     return username;
-    // else
-    return id;
+    if (tableName == "user")
+        return username;
+    else
+        return id;
+}
+
+StorageConfig StorageConfig::fromFile(const QString &fileName)
+{
+    StorageConfig config;
+    QFile file(fileName);
+    if (!file.open(QIODevice::ReadOnly))
+        return config;
+
+    QJsonParseError error;
+    QJsonObject json = QJsonDocument::fromJson(file.readAll(), &error).object();
+    if (error.error != QJsonParseError::NoError)
+    {
+        qCritical() << "数据库:存储配置文件" << fileName << "格式有误" << error.errorString();
+        return config;
+    }
+    config.path = json["path"].toString(config.path);
+    config.journalMode = json["journal_mode"].toString();
+    config.synchronous = json["synchronous"].toString();
+    config.cacheSize = json["cache_size"].toInt(config.cacheSize);
+    if (json.contains("mmap_size"))
+        config.mmapSize = json["mmap_size"].toVariant().toLongLong();
+    config.tempStore = json["temp_store"].toString();
+    return config;
+}
+
+StorageConfig StorageConfig::inMemory()
+{
+    StorageConfig config;
+    config.path = ":memory:";
+    config.tempStore = "MEMORY";
+    return config;
 }
 
-Database::Database(const QString &connectionName, const QString &fileName) : userFileName(fileName), usernameSet()
+Database::Connection::~Connection()
 {
-    db = QSqlDatabase::addDatabase("QSQLITE", connectionName);
-    db.setDatabaseName("MyDataBase.sqlite");
-    db.open();
+    statementCache.clear();
+    filterStatementCache.clear();
+    db.close();
+    db = QSqlDatabase();
+    QSqlDatabase::removeDatabase(name);
+}
+
+Database::Connection &Database::connection() const
+{
+    Connection *conn = connections.localData();
+    if (conn)
+        return *conn;
+
+    conn = new Connection;
+    conn->name = baseConnectionName + "_" + QString::number(connectionCount.fetchAndAddRelaxed(1));
+    conn->db = QSqlDatabase::addDatabase("QSQLITE", conn->name);
+    if (storageConfig.path == ":memory:")
+    {
+        //每个:memory:连接是各自独立的数据库，用共享缓存的命名内存数据库让所有线程看到同一份数据
+        conn->db.setDatabaseName("file:" + baseConnectionName + "?mode=memory&cache=shared");
+        conn->db.setConnectOptions("QSQLITE_OPEN_URI");
+    }
+    else
+        conn->db.setDatabaseName(storageConfig.path);
+    if (!conn->db.open())
+        qCritical() << "数据库:打开" << storageConfig.path << "失败" << conn->db.lastError();
+    applyStorageConfig(conn->db);
+    connections.setLocalData(conn);
+    qDebug() << "数据库:打开连接" << conn->name;
+    return *conn;
+}
+
+Database::Database(const QString &connectionName, const QString &fileName, const StorageConfig &config) : baseConnectionName(connectionName), storageConfig(config), userFileName(fileName)
+{
+    QSqlDatabase &db = connection().db;
 
     if (!db.tables().contains("item")) //若不包含item，则创建。
+        createItemTable();
+    else if (db.record("item").contains("sendingTime_Year")) //旧版本的item表，日期分为年月日三列
+        migrateItemTable();
+    else
+        qDebug() << "item表已存在";
+    createItemIndexes();
+    createSequenceTable();
+
+    if (!db.tables().contains("user")) //若不包含user，则创建，并导入旧的用户文件。
+        createUserTable();
+    else
+        qDebug() << "user表已存在";
+
+    if (!queryUserByName("admin"))
+        insertUser("admin", "123", ADMINISTRATOR, 0, "管理员", "88888888", "环宇物流大厦");
+}
+
+void Database::applyStorageConfig(QSqlDatabase &db) const
+{
+    const StorageConfig &config = storageConfig;
+    //PRAGMA不能绑定参数，字符串取值只接受下列关键字
+    static const QStringList journalModes{"DELETE", "TRUNCATE", "PERSIST", "MEMORY", "WAL", "OFF"};
+    static const QStringList synchronousLevels{"OFF", "NORMAL", "FULL", "EXTRA"};
+    static const QStringList tempStores{"DEFAULT", "FILE", "MEMORY"};
+
+    QStringList pragmas;
+    if (journalModes.contains(config.journalMode.toUpper()))
+        pragmas.append("journal_mode = " + config.journalMode.toUpper());
+    else if (!config.journalMode.isEmpty())
+        qWarning() << "数据库:忽略不支持的journal_mode" << config.journalMode;
+    if (synchronousLevels.contains(config.synchronous.toUpper()))
+        pragmas.append("synchronous = " + config.synchronous.toUpper());
+    else if (!config.synchronous.isEmpty())
+        qWarning() << "数据库:忽略不支持的synchronous" << config.synchronous;
+    if (config.cacheSize != 0)
+        pragmas.append("cache_size = " + QString::number(config.cacheSize));
+    if (config.mmapSize >= 0)
+        pragmas.append("mmap_size = " + QString::number(config.mmapSize));
+    if (tempStores.contains(config.tempStore.toUpper()))
+        pragmas.append("temp_store = " + config.tempStore.toUpper());
+    else if (!config.tempStore.isEmpty())
+        qWarning() << "数据库:忽略不支持的temp_store" << config.tempStore;
+
+    for (const QString &pragma : pragmas)
     {
+        //journal_mode和mmap_size会返回实际生效的值，可能与设置的不同
         QSqlQuery sqlQuery(db);
-        sqlQuery.prepare("CREATE TABLE item( id INT PRIMARY KEY NOT NULL,"
-                         "cost INT NOT NULL,"
-                         //  "type INT NOT NULL,"//pahse2开始有
-                         "state INT NOT NULL,"
-                         "sendingTime_Year INT NOT NULL,"
-                         "sendingTime_Month INT NOT NULL,"
-                         "sendingTime_Day INT NOT NULL,"
-                         "receivingTime_Year INT NOT NULL,"
-                         "receivingTime_Month INT NOT NULL,"
-                         "receivingTime_Day INT NOT NULL,"
-                         "srcName TEXT NOT NULL,"
-                         "dstName TEXT NOT NULL,"
-                         "description TEXT NOT NULL) ");
-
-        exec(sqlQuery);
-        if (!sqlQuery.exec())
-            qCritical() << "item表创建失败" << sqlQuery.lastError();
+        if (!sqlQuery.exec("PRAGMA " + pragma))
+            qCritical() << "数据库:设置" << pragma << "失败" << sqlQuery.lastError();
+        else if (sqlQuery.next())
+            qDebug() << "数据库:" << pragma << "生效值为" << sqlQuery.value(0).toString();
         else
-            qDebug() << "item表创建成功";
+            qDebug() << "数据库:" << pragma;
+    }
+}
+
+bool Database::createItemTable() const
+{
+    Connection &conn = connection();
+    QSqlQuery sqlQuery(conn.db);
+    sqlQuery.prepare("CREATE TABLE item( id INTEGER PRIMARY KEY NOT NULL,"
+                     "cost INT NOT NULL,"
+                     //  "type INT NOT NULL,"//pahse2开始有
+                     "state INT NOT NULL,"
+                     "sendingDate INT NOT NULL,"
+                     "receivingDate INT NOT NULL,"
+                     "srcName TEXT NOT NULL,"
+                     "dstName TEXT NOT NULL,"
+                     "description TEXT NOT NULL) ");
+
+    if (!exec(sqlQuery))
+    {
+        qCritical() << "item表创建失败" << sqlQuery.lastError();
+        return false;
+    }
+    qDebug() << "item表创建成功";
+    return true;
+}
+
+void Database::migrateItemTable()
+{
+    Connection &conn = connection();
+    //与Time::toOrdinal的换算相同, 年为-1(未接收)时为-1
+    static const char *const copyItems =
+        "INSERT INTO item SELECT id, cost, state,"
+        " CASE WHEN sendingTime_Year = -1 THEN -1 ELSE (sendingTime_Year * 12 + sendingTime_Month - 1) * 31 + sendingTime_Day - 1 END,"
+        " CASE WHEN receivingTime_Year = -1 THEN -1 ELSE (receivingTime_Year * 12 + receivingTime_Month - 1) * 31 + receivingTime_Day - 1 END,"
+        " srcName, dstName, description FROM item_old";
+
+    qDebug() << "item表为旧版本，开始转换日期列";
+    conn.db.transaction();
+    if (!execStatement("ALTER TABLE item RENAME TO item_old") ||
+        !createItemTable() ||
+        !execStatement(copyItems) ||
+        !execStatement("DROP TABLE item_old") ||
+        !conn.db.commit())
+    {
+        qCritical() << "数据库:item表转换失败" << conn.db.lastError();
+        conn.db.rollback();
+        Logger::flush(); //exit不会析构main中的Logger
+        exit(1);
+    }
+    qDebug() << "数据库:item表转换成功";
+}
+
+void Database::createSequenceTable() const
+{
+    Connection &conn = connection();
+    //next为下一个可分配的值，预留时还会与表中实际的最大单号比较，旧数据和恢复的快照不会造成重复
+    static const char *const statements[] = {
+        "CREATE TABLE IF NOT EXISTS sequence( name TEXT PRIMARY KEY NOT NULL, next INT NOT NULL) WITHOUT ROWID",
+        "INSERT OR IGNORE INTO sequence VALUES('item', 1)"};
+    for (const char *statement : statements)
+    {
+        QSqlQuery sqlQuery(conn.db);
+        if (!sqlQuery.exec(statement))
+            qCritical() << "数据库:创建sequence表失败" << statement << sqlQuery.lastError();
+    }
+}
+
+int Database::reserveItemIds(int count)
+{
+    Connection &conn = connection();
+    //先UPDATE取得写锁，其他线程和进程的预留只能排在本事务之后
+    if (!beginTransaction())
+        return -1;
+    QSqlQuery &update = prepareCached(QStringLiteral("UPDATE sequence SET next = MAX(next, (SELECT IFNULL(MAX(id), 0) + 1 FROM item)) + :count WHERE name = 'item'"));
+    update.bindValue(":count", count);
+    bool flag = exec(update) && update.numRowsAffected() == 1;
+
+    int next = -1;
+    if (flag)
+    {
+        QSqlQuery &select = prepareCached(QStringLiteral("SELECT next FROM sequence WHERE name = 'item'"));
+        flag = exec(select) && select.next();
+        if (flag)
+            next = select.value(0).toInt();
+        select.finish();
+    }
+
+    if (!flag || !commitTransaction())
+    {
+        qCritical() << "数据库:预留" << count << "个物品单号失败" << conn.db.lastError();
+        rollbackTransaction();
+        return -1;
+    }
+    qDebug() << "数据库:预留物品单号" << next - count << "至" << next - 1;
+    return next - count;
+}
+
+int Database::getReservationEpoch() const
+{
+    return reservationEpoch.loadAcquire();
+}
+
+int Database::getCacheEpoch(const int id) const
+{
+    QMutexLocker locker(&dirtyMutex);
+    return dirtyAllCount > 0 || dirtyItems.contains(id) ? -1 : itemEpoch;
+}
+
+void Database::markItemDirty(const int id) const
+{
+    Connection &conn = connection();
+    QMutexLocker locker(&dirtyMutex);
+    if (conn.transactionDepth == 0)
+        itemEpoch++;
+    else if (id == -1)
+    {
+        if (!conn.dirtyAllItems)
+            dirtyAllCount++;
+        conn.dirtyAllItems = true;
     }
     else
-        qDebug() << "item表已存在";
+    {
+        dirtyItems[id]++;
+        conn.dirtyItems.append(id);
+    }
+}
+
+void Database::outerTransactionEnded()
+{
+    Connection &conn = connection();
+    if (conn.dirtyItems.isEmpty() && !conn.dirtyAllItems)
+        return;
+    QMutexLocker locker(&dirtyMutex);
+    for (int id : conn.dirtyItems)
+        if (--dirtyItems[id] == 0)
+            dirtyItems.remove(id);
+    if (conn.dirtyAllItems)
+        dirtyAllCount--;
+    //查询开始时取得的版本因此改变, 事务结束前查到的值不会放入缓存
+    itemEpoch++;
+    conn.dirtyItems.clear();
+    conn.dirtyAllItems = false;
+}
+
+void Database::createItemIndexes() const
+{
+    Connection &conn = connection();
+    //与UserManage::queryItem发出的查询对应: 按寄件人/收件人查询(可再加寄送日期范围)，以及管理员按日期范围查询
+    //按寄件人/收件人分页时按单号排序，(用户名, id)索引让每页只在索引上读取limit行，不需要临时排序
+    static const char *const indexes[] = {
+        "CREATE INDEX IF NOT EXISTS item_srcName_sendingDate ON item(srcName, sendingDate)",
+        "CREATE INDEX IF NOT EXISTS item_dstName_sendingDate ON item(dstName, sendingDate)",
+        "CREATE INDEX IF NOT EXISTS item_srcName_id ON item(srcName, id)",
+        "CREATE INDEX IF NOT EXISTS item_dstName_id ON item(dstName, id)",
+        "CREATE INDEX IF NOT EXISTS item_sendingDate ON item(sendingDate)",
+        "CREATE INDEX IF NOT EXISTS item_receivingDate ON item(receivingDate)"};
+    for (const char *index : indexes)
+    {
+        QSqlQuery sqlQuery(conn.db);
+        if (!sqlQuery.exec(index))
+            qCritical() << "数据库:创建索引失败" << index << sqlQuery.lastError();
+    }
+}
+
+void Database::createUserTable()
+{
+    //建表和导入在同一个事务中: 导入失败时表也被回滚, 下次启动会重新导入, 而不是留下一张空表
+    Connection &conn = connection();
+    QSqlQuery sqlQuery(conn.db);
+    sqlQuery.prepare("CREATE TABLE user( username TEXT PRIMARY KEY NOT NULL,"
+                     "password TEXT NOT NULL,"
+                     "type INT NOT NULL,"
+                     "balance INT NOT NULL,"
+                     "name TEXT NOT NULL,"
+                     "phoneNumber TEXT NOT NULL,"
+                     "address TEXT NOT NULL) WITHOUT ROWID");
+    bool migrated = false;
+    bool flag = conn.db.transaction();
+    if (flag && !exec(sqlQuery))
+    {
+        qCritical() << "user表创建失败" << sqlQuery.lastError();
+        flag = false;
+    }
+    //纯内存模式不读写任何文件
+    if (flag && !isInMemory())
+        flag = migrateUserFile(migrated);
+    if (!flag || !conn.db.commit())
+    {
+        qCritical() << "数据库:创建user表并导入用户文件失败" << conn.db.lastError();
+        conn.db.rollback();
+        Logger::flush();
+        exit(1);
+    }
+    qDebug() << "user表创建成功";
+    if (migrated)
+        archiveUserFile();
+}
+
+bool Database::migrateUserFile(bool &migrated)
+{
+    QDir dir;
+    QString tempFileName = userFileName + ".tmp";
+    QString logFileName = userFileName + ".log";
+    QString oldLogFileName = userFileName + ".log.old";
+
+    //上次合并在删除原文件后、重命名前中断，临时文件即为完整的用户文件
+    if (!QFile::exists(userFileName) && QFile::exists(tempFileName))
+        dir.rename(tempFileName, userFileName);
+    if (!QFile::exists(userFileName))
+        return true;
 
     QFile userFile(userFileName);
-    if (!userFile.open(QIODevice::ReadWrite | QIODevice ::Text))
+    if (!userFile.open(QIODevice::ReadOnly | QIODevice ::Text))
     {
         qCritical() << "user文件打开失败";
+        Logger::flush();
         exit(1);
     }
 
+    QHash<QString, UserRecord> userTable;
     QTextStream stream;
-    bool isAdministratorExist = false;
     stream.setDevice(&userFile);
     int type, balance;
     QString username, password, name, phoneNumber, address;
@@ -82,392 +442,901 @@ Database::Database(const QString &connectionName, const QString &fileName) : use
     {
         stream >> username >> password >> type >> balance >> name >> phoneNumber >> address;
         stream >> ch;
-        usernameSet.insert(username);
-        if (username == "admin")
-            isAdministratorExist = true;
+        if (username.isEmpty())
+            continue;
+        userTable.insert(username, UserRecord{password, type, balance, name, phoneNumber, address});
     }
-    if (!isAdministratorExist)
-        insertUser("admin", "123", ADMINISTRATOR, 0, "管理员", "88888888", "环宇物流大厦");
+    userFile.close();
+
+    //先回放上次未完成合并的日志，再回放当前日志
+    replayUserLog(oldLogFileName, userTable);
+    replayUserLog(logFileName, userTable);
+
+    for (auto i = userTable.constBegin(); i != userTable.constEnd(); i++)
+        if (!insertUser(i.key(), i->password, i->type, i->balance, i->name, i->phoneNumber, i->address))
+        {
+            qCritical() << "数据库:导入用户" << i.key() << "失败";
+            return false;
+        }
+    migrated = true;
+    qDebug() << "数据库:从" << userFileName << "读取用户" << userTable.size() << "个";
+    return true;
+}
+
+void Database::archiveUserFile()
+{
+    QDir dir;
+    QString tempFileName = userFileName + ".tmp";
+    QString logFileName = userFileName + ".log";
+    QString oldLogFileName = userFileName + ".log.old";
+
+    //导入成功后保留原文件备查，但不再读取
+    dir.remove(userFileName + ".migrated");
+    dir.rename(userFileName, userFileName + ".migrated");
+    dir.remove(tempFileName);
+    dir.remove(logFileName);
+    dir.remove(oldLogFileName);
+    qDebug() << "数据库:用户文件" << userFileName << "导入完成";
+}
+
+int Database::replayUserLog(const QString &logFileName, QHash<QString, UserRecord> &userTable)
+{
+    QFile logFile(logFileName);
+    if (!logFile.exists() || !logFile.open(QIODevice::ReadOnly | QIODevice ::Text))
+        return 0;
+
+    QTextStream stream(&logFile);
+    int cnt = 0;
+    QString op, username;
+    while (!stream.atEnd())
+    {
+        op.clear();
+        username.clear();
+        stream >> op >> username;
+        if (username.isEmpty())
+            continue;
+        if (op == "I")
+        {
+            UserRecord record;
+            stream >> record.password >> record.type >> record.balance >> record.name >> record.phoneNumber >> record.address;
+            userTable.insert(username, record);
+        }
+        else if (op == "P")
+            stream >> userTable[username].password;
+        else if (op == "B")
+            stream >> userTable[username].balance;
+        else
+        {
+            qCritical() << "文件:用户修改日志" << logFileName << "中有无法识别的记录" << op;
+            break;
+        }
+        stream.readLine(); //吃掉行尾
+        cnt++;
+    }
+    return cnt;
 }
 
 bool Database::modifyData(const QString &tableName, const QString &primaryKey, const QString &key, int value) const
 {
-    QSqlQuery sqlQuery(db);
-    sqlQuery.prepare("UPDATE " + tableName + " SET " + key + " = :value WHERE " + getPrimaryKeyByTableName(tableName) + " = :primaryKey");
+    QSqlQuery &sqlQuery = prepareCached("UPDATE " + tableName + " SET " + key + " = :value WHERE " + getPrimaryKeyByTableName(tableName) + " = :primaryKey");
     sqlQuery.bindValue(":value", value);
     sqlQuery.bindValue(":primaryKey", primaryKey);
 
-    exec(sqlQuery);
-    if (sqlQuery.exec())
-    {
-        qDebug() << "数据库: " << key << " : "
-                 << value
-                 << " 修改成功";
+    if (exec(sqlQuery) && sqlQuery.numRowsAffected() > 0)
         return true;
-    }
-    else
-    {
-        qCritical() << "数据库: " << key << " : "
-                    << value
-                    << " 修改失败" << sqlQuery.lastError();
-        return false;
-    }
+
+    qCritical() << "数据库: " << key << " : "
+                << value
+                << " 修改失败" << sqlQuery.lastError();
+    return false;
 }
 
 bool Database::modifyData(const QString &tableName, const QString &primaryKey, const QString &key, const QString value) const
 {
-    QSqlQuery sqlQuery(db);
-    sqlQuery.prepare("UPDATE " + tableName + " SET " + key + " = :value WHERE " + getPrimaryKeyByTableName(tableName) + " = :primaryKey");
+    QSqlQuery &sqlQuery = prepareCached("UPDATE " + tableName + " SET " + key + " = :value WHERE " + getPrimaryKeyByTableName(tableName) + " = :primaryKey");
     sqlQuery.bindValue(":value", value);
     sqlQuery.bindValue(":primaryKey", primaryKey);
 
-    exec(sqlQuery);
-    if (sqlQuery.exec())
-    {
-        qDebug() << "数据库: " << key << " : "
-                 << value
-                 << " 修改成功";
+    if (exec(sqlQuery) && sqlQuery.numRowsAffected() > 0)
         return true;
-    }
-    else
-    {
-        qCritical() << "数据库: " << key << " : "
-                    << value
-                    << " 修改失败" << sqlQuery.lastError();
-        return false;
-    }
+
+    qCritical() << "数据库: " << key << " : "
+                << value
+                << " 修改失败" << sqlQuery.lastError();
+    return false;
 }
 
-void Database::insertUser(const QString &username, const QString &password, int type, int balance, const QString &name, const QString &phoneNumber, const QString &address)
+bool Database::insertUser(const QString &username, const QString &password, int type, int balance, const QString &name, const QString &phoneNumber, const QString &address)
 {
-
-    if (!usernameSet.contains(username))
+    QSqlQuery &sqlQuery = prepareCached(QStringLiteral("INSERT INTO user VALUES(:username, :password, :type, :balance, :name, :phoneNumber, :address)"));
+    sqlQuery.bindValue(":username", username);
+    sqlQuery.bindValue(":password", password);
+    sqlQuery.bindValue(":type", type);
+    sqlQuery.bindValue(":balance", balance);
+    sqlQuery.bindValue(":name", name);
+    sqlQuery.bindValue(":phoneNumber", phoneNumber);
+    sqlQuery.bindValue(":address", address);
+    if (!exec(sqlQuery))
     {
-        qDebug() << "文件：插入user " << username << " 成功";
-        usernameSet.insert(username);
-        QFile userFile(userFileName);
-        if (!userFile.open(QIODevice::ReadWrite | QIODevice ::Text))
-        {
-            qCritical() << "user文件打开失败";
-            exit(1);
-        }
-        QTextStream stream(&userFile);
-
-        int tempType, tempBalance;
-        QString tempUsername, tempPassword, tempName, tempPhoneNumber, tempAddress;
-        char ch;
-        while (!stream.atEnd())
-        {
-            stream >> tempUsername >> tempPassword >> tempType >> tempType >> tempName >> tempPhoneNumber >> tempAddress;
-            stream >> ch;
-        }
-        qDebug() << username << password << type << balance << name << phoneNumber << address;
-        stream << username << " " << password << " " << type << " " << balance << " " << name << " " << phoneNumber << " " << address << Qt::endl;
-        userFile.close();
+        qCritical() << "数据库:插入user " << username << " 失败 " << sqlQuery.lastError();
+        return false;
     }
-    else
-        qCritical() << "文件：插入user " << username << "失败"
-                    << "该用户已存在文件中";
+    qDebug() << "数据库:插入user " << username << " 成功";
+    return true;
 }
 
 bool Database::queryUserByName(const QString &targetUsername) const
 {
-    if (!usernameSet.contains(targetUsername))
+    QSqlQuery &sqlQuery = prepareCached(QStringLiteral("SELECT 1 FROM user WHERE username = :username"));
+    sqlQuery.bindValue(":username", targetUsername);
+    bool flag = exec(sqlQuery) && sqlQuery.next();
+    sqlQuery.finish();
+    if (!flag)
     {
-        qDebug() << "文件:" << targetUsername << "在文件中不存在";
+        qDebug() << "数据库:" << targetUsername << "在数据库中不存在";
         return false;
     }
-    qDebug() << "文件:" << targetUsername << "在文件中存在";
+    qDebug() << "数据库:" << targetUsername << "在数据库中存在";
     return true;
 }
 
 bool Database::queryUserByName(const QString &targetUsername, QString &retPassword, int &retType, int &retBalance, QString &retName, QString &retPhoneNumber, QString &retAddress) const
 {
-    if (!usernameSet.contains(targetUsername))
+    QSqlQuery &sqlQuery = prepareCached(QStringLiteral("SELECT password, type, balance, name, phoneNumber, address FROM user WHERE username = :username"));
+    sqlQuery.bindValue(":username", targetUsername);
+    if (!exec(sqlQuery) || !sqlQuery.next())
     {
-        qDebug() << "文件:" << targetUsername << "在文件中不存在";
+        sqlQuery.finish();
+        qDebug() << "数据库:" << targetUsername << "在数据库中不存在";
         return false;
     }
 
-    QFile userFile1(userFileName);
-    if (!userFile1.open(QIODevice::ReadWrite | QIODevice ::Text))
-    {
-        qCritical() << "user文件打开失败";
-        exit(1);
-    }
-    QTextStream stream(&userFile1);
-    int type, balance;
-    QString username, password, name, phoneNumber, address;
-    char ch;
-    while (!stream.atEnd() && username != targetUsername)
+    retPassword = sqlQuery.value(0).toString();
+    retType = sqlQuery.value(1).toInt();
+    retBalance = sqlQuery.value(2).toInt();
+    retName = sqlQuery.value(3).toString();
+    retPhoneNumber = sqlQuery.value(4).toString();
+    retAddress = sqlQuery.value(5).toString();
+    sqlQuery.finish();
+    qDebug() << "数据库:" << targetUsername << "在数据库中存在";
+    return true;
+}
+
+QStringList Database::queryAllUsername() const
+{
+    QStringList result;
+    QSqlQuery &sqlQuery = prepareCached(QStringLiteral("SELECT username FROM user"));
+    if (!exec(sqlQuery))
     {
-        stream >> username >> password >> type >> balance >> name >> phoneNumber >> address;
-        stream >> ch; //吃一个回车
+        qCritical() << "数据库:查找所有用户失败" << sqlQuery.lastError();
+        return result;
     }
-
-    retPassword = password;
-    retType = type;
-    retName = name;
-    retBalance = balance;
-    retPhoneNumber = phoneNumber;
-    retAddress = address;
-    qDebug() << "文件:" << targetUsername << "在文件中存在";
-    return true;
+    while (sqlQuery.next())
+        result.append(sqlQuery.value(0).toString());
+    sqlQuery.finish();
+    return result;
 }
 
 int Database::queryBalanceByName(const QString &username) const
 {
-    int type, balance;
-    QString password, name, phoneNumber, address;
+    QSqlQuery &sqlQuery = prepareCached(QStringLiteral("SELECT balance FROM user WHERE username = :username"));
+    sqlQuery.bindValue(":username", username);
+    int balance = -1;
+    if (exec(sqlQuery) && sqlQuery.next())
+        balance = sqlQuery.value(0).toInt();
+    sqlQuery.finish();
+    return balance;
+}
 
-    if (!queryUserByName(username, password, type, balance, name, phoneNumber, address))
-        return -1;
-    else
-        return balance;
+bool Database::modifyUserPassword(const QString &targetUsername, const QString &targetPassword)
+{
+    return modifyData("user", targetUsername, "password", targetPassword);
+}
+
+bool Database::modifyUserBalance(const QString &targetUsername, int targetBalance)
+{
+    return modifyData("user", targetUsername, "balance", targetBalance);
 }
 
-bool Database::modifyUserPassword(const QString &targetUsername, const QString &targetPassword) const
+bool Database::transferBalance(const QString &srcUsername, const QString &dstUsername, int amount)
 {
-    if (!usernameSet.contains(targetUsername))
+    if (!beginTransaction())
         return false;
 
-    int type, balance;
-    QString username, password, name, phoneNumber, address;
-    char ch;
-    QFile userFile1(userFileName), userFile2("tempUsers.txt");
-    if (!userFile1.open(QIODevice::ReadWrite | QIODevice ::Text))
+    QSqlQuery &sqlQuery = prepareCached(QStringLiteral("UPDATE user SET balance = balance + :addend WHERE username = :username"));
+    sqlQuery.bindValue(":addend", -amount);
+    sqlQuery.bindValue(":username", srcUsername);
+    bool flag = exec(sqlQuery) && sqlQuery.numRowsAffected() == 1;
+    if (flag)
     {
-        qCritical() << "user文件打开失败";
-        exit(1);
+        sqlQuery.bindValue(":addend", amount);
+        sqlQuery.bindValue(":username", dstUsername);
+        flag = exec(sqlQuery) && sqlQuery.numRowsAffected() == 1;
     }
-    if (!userFile2.open(QIODevice::ReadWrite | QIODevice ::Text))
+
+    if (!flag || !commitTransaction())
     {
-        qCritical() << "user文件打开失败";
-        exit(1);
+        qCritical() << "数据库:从" << srcUsername << "转账" << amount << "给" << dstUsername << "失败" << sqlQuery.lastError();
+        rollbackTransaction();
+        return false;
     }
-    QTextStream stream1(&userFile1);
-    QTextStream stream2(&userFile2);
+    qDebug() << "数据库:从" << srcUsername << "转账" << amount << "给" << dstUsername << "成功";
+    return true;
+}
 
-    while (!stream1.atEnd())
+bool Database::beginTransaction()
+{
+    Connection &conn = connection();
+    bool flag = conn.transactionDepth == 0 ? conn.db.transaction() : execStatement("SAVEPOINT sp" + QString::number(conn.transactionDepth));
+    if (!flag)
     {
-        stream1 >> username >> password >> type >> balance >> name >> phoneNumber >> address;
-        stream1 >> ch; //吃一个回车
-        qDebug() << username << password << type << balance << name << phoneNumber << address;
-        if (username == targetUsername)
-            password = targetPassword;
-        stream2 << username << " " << password << " " << type << " " << balance << " " << name << " " << phoneNumber << " " << address << Qt::endl;
+        qCritical() << "数据库:开始事务失败" << conn.db.lastError();
+        return false;
     }
-    userFile1.close();
-    userFile2.close();
-    QDir dir;
-    dir.remove(userFileName);
-    dir.rename("tempUsers.txt", userFileName);
+    conn.transactionDepth++;
     return true;
 }
 
-bool Database::modifyUserBalance(const QString &targetUsername, int targetBalance) const
+bool Database::commitTransaction()
 {
-    if (!usernameSet.contains(targetUsername))
+    Connection &conn = connection();
+    if (conn.transactionDepth == 0)
         return false;
-
-    int type, balance;
-    QString username, password, name, phoneNumber, address;
-    char ch;
-    QFile userFile1(userFileName), userFile2("tempUsers.txt");
-    if (!userFile1.open(QIODevice::ReadWrite | QIODevice ::Text))
+    bool flag = conn.transactionDepth == 1 ? conn.db.commit() : execStatement("RELEASE SAVEPOINT sp" + QString::number(conn.transactionDepth - 1));
+    if (!flag)
     {
-        qCritical() << "user文件打开失败";
-        exit(1);
+        qCritical() << "数据库:提交事务失败" << conn.db.lastError();
+        return false;
     }
-    if (!userFile2.open(QIODevice::ReadWrite | QIODevice ::Text))
+    conn.transactionDepth--;
+    if (conn.transactionDepth == 0)
+        outerTransactionEnded();
+    return true;
+}
+
+bool Database::rollbackTransaction()
+{
+    Connection &conn = connection();
+    if (conn.transactionDepth == 0)
+        return false;
+    //回滚可能撤销了sequence表的修改，之前预留的单号作废
+    reservationEpoch.ref();
+    conn.transactionDepth--;
+    if (conn.transactionDepth == 0)
     {
-        qCritical() << "user文件打开失败";
-        exit(1);
+        bool flag = conn.db.rollback();
+        outerTransactionEnded();
+        return flag;
     }
-    QTextStream stream1(&userFile1);
-    QTextStream stream2(&userFile2);
+    QString savepoint = "sp" + QString::number(conn.transactionDepth);
+    return execStatement("ROLLBACK TO SAVEPOINT " + savepoint) && execStatement("RELEASE SAVEPOINT " + savepoint);
+}
+
+Database::~Database()
+{
+    stopGroupCommit();
+    connections.setLocalData(nullptr); //删除当前线程的连接
+}
 
-    while (!stream1.atEnd())
+void Database::setGroupCommit(int maxOps, int maxDelay)
+{
+    stopGroupCommit();
+    if (maxOps > 0 && isInMemory())
     {
-        stream1 >> username >> password >> type >> balance >> name >> phoneNumber >> address;
-        stream1 >> ch; //吃一个回车
-        qDebug() << username << password << type << balance << name << phoneNumber << address;
-        if (username == targetUsername)
-            balance = targetBalance;
-        stream2 << username << " " << password << " " << type << " " << balance << " " << name << " " << phoneNumber << " " << address << Qt::endl;
+        qWarning() << "数据库:纯内存存储不能开启组提交, 写线程的连接会与其他连接冲突";
+        maxOps = 0;
     }
-    userFile1.close();
-    userFile2.close();
-    QDir dir;
-    dir.remove(userFileName);
-    dir.rename("tempUsers.txt", userFileName);
-    return true;
+    //没有给出等待时间时(如未设置DATABASE_GROUP_COMMIT_MS)每次修改都会立即提交, 用默认值
+    if (maxOps > 0 && maxDelay <= 0)
+        maxDelay = GROUP_COMMIT_DEFAULT_DELAY;
+    groupCommitMaxOps = maxOps;
+    groupCommitMaxDelay = maxDelay;
+    if (maxOps <= 0)
+        return;
+    groupWriter.reset(QThread::create([this]()
+                                      { runGroupCommit(); }));
+    groupWriter->start();
+    qDebug() << "数据库:开启组提交, 每" << maxOps << "次修改或" << maxDelay << "毫秒提交一次";
 }
 
-int Database::getDBMaxId(const QString &tableName) const
+void Database::stopGroupCommit()
 {
-    QSqlQuery sqlQuery(db);
-    sqlQuery.prepare("SELECT MAX(id) FROM " + tableName);
-
-    exec(sqlQuery);
-    if (!sqlQuery.exec())
+    if (!groupWriter)
+        return;
     {
-        qCritical() << "数据库:获得表 " << tableName << " 中主键的最大ID失败";
-        return 0;
+        QMutexLocker locker(&groupMutex);
+        groupStopping = true;
+        groupWake.wakeOne();
     }
-    else
+    groupWriter->wait();
+    groupWriter.reset();
+    groupStopping = false;
+}
+
+bool Database::writeInTransaction(const std::function<bool()> &write)
+{
+    if (!beginTransaction())
+        return false;
+    if (write() && commitTransaction())
+        return true;
+    rollbackTransaction();
+    return false;
+}
+
+bool Database::groupWrite(const std::function<bool()> &write)
+{
+    Connection &conn = connection();
+    //写线程执行的修改和调用者事务中的修改都直接执行, 后者要与调用者的其他修改一起提交或回滚
+    if (!groupWriter || conn.transactionDepth > 0)
+        return writeInTransaction(write);
+
+    GroupJob job;
+    job.write = &write;
+    QMutexLocker locker(&groupMutex);
+    groupQueue.enqueue(&job);
+    groupWake.wakeOne();
+    while (!job.done)
+        groupDone.wait(&groupMutex);
+    conn.groupLastBatch = qMax(conn.groupLastBatch, job.batch);
+    return job.result;
+}
+
+void Database::runGroupCommit()
+{
+    Connection &conn = connection();
+    bool open = false;   //是否有打开的组事务
+    int pending = 0;     //组事务中成功的修改数
+    QElapsedTimer timer; //组事务打开的时间
+    QMutexLocker locker(&groupMutex);
+    while (true)
     {
-        qDebug() << "数据库:获得表 " << tableName << " 中主键的最大ID成功.";
-        if (sqlQuery.next())
-            return sqlQuery.value(0).toInt();
-        return 0;
+        GroupJob *job = groupQueue.isEmpty() ? nullptr : groupQueue.dequeue();
+        bool committed = true;
+        if (open && (pending >= groupCommitMaxOps || timer.elapsed() >= groupCommitMaxDelay || groupStopping || (job && !job->write)))
+        {
+            quint64 batch = groupBatch;
+            locker.unlock();
+            committed = commitTransaction();
+            if (!committed)
+            {
+                qCritical() << "数据库:提交组事务失败, 丢弃" << pending << "次修改";
+                rollbackTransaction();
+            }
+            else
+                qDebug() << "数据库:组提交" << pending << "次修改";
+            locker.relock();
+            open = false;
+            pending = 0;
+            if (!committed)
+                groupFailed.append(batch);
+            groupCommitted = batch;
+            groupBatch++;
+            groupDone.wakeAll();
+        }
+
+        if (job)
+        {
+            bool result = committed;
+            if (job->write)
+            {
+                //每次修改在组事务中的一个SAVEPOINT里执行, 失败时只回滚它自己
+                locker.unlock();
+                if (!open && beginTransaction())
+                {
+                    open = true;
+                    timer.start();
+                }
+                result = open && writeInTransaction(*job->write);
+                if (open && conn.transactionDepth != 1)
+                {
+                    //修改中多余的回滚结束了组事务, 其中之前的修改都已丢失
+                    qCritical() << "数据库:组事务被意外结束, 丢弃" << pending << "次修改";
+                    while (conn.transactionDepth > 0)
+                        rollbackTransaction();
+                    result = false;
+                }
+                locker.relock();
+                if (open && conn.transactionDepth == 0)
+                {
+                    open = false;
+                    pending = 0;
+                    groupFailed.append(groupBatch);
+                    groupCommitted = groupBatch;
+                    groupBatch++;
+                }
+                if (result)
+                {
+                    pending++;
+                    job->batch = groupBatch;
+                }
+            }
+            job->result = result;
+            job->done = true;
+            groupDone.wakeAll();
+            continue;
+        }
+
+        if (groupStopping && !open)
+            break;
+        //队列已空: 有打开的组事务时最多等到它超时, 否则等待新的修改
+        if (open)
+            groupWake.wait(&groupMutex, qMax<qint64>(groupCommitMaxDelay - timer.elapsed(), 1));
+        else
+            groupWake.wait(&groupMutex);
     }
 }
 
-void Database::insertItem(int id, int cost, int state, const Time &sendingTime, const Time &receivingTime, const QString &srcName, const QString &dstName, const QString &description)
+bool Database::waitGroupCommit()
 {
-    QSqlQuery sqlQuery(db);
-    sqlQuery.prepare("INSERT INTO item VALUES(:id, :cost, :state,"
-                     " :sendingTime_Year, :sendingTime_Month, :sendingTime_Day,"
-                     " :receivingTime_Year, :receivingTime_Month, :receivingTime_Day,"
-                     " :srcName, :dstName, :description)"); // phase2开始添加type
-    sqlQuery.bindValue(":id", id);
-    sqlQuery.bindValue(":cost", cost);
-    sqlQuery.bindValue(":state", state);
-    sqlQuery.bindValue(":sendingTime_Year", sendingTime.year);
-    sqlQuery.bindValue(":sendingTime_Month", sendingTime.month);
-    sqlQuery.bindValue(":sendingTime_Day", sendingTime.day);
-    sqlQuery.bindValue(":receivingTime_Year", receivingTime.year);
-    sqlQuery.bindValue(":receivingTime_Month", receivingTime.month);
-    sqlQuery.bindValue(":receivingTime_Day", receivingTime.day);
-    sqlQuery.bindValue(":srcName", srcName);
-    sqlQuery.bindValue(":dstName", dstName);
-    sqlQuery.bindValue(":description", description);
-    exec(sqlQuery);
-    if (!sqlQuery.exec())
-        qCritical() << "数据库:插入id为 " << id << " 的物品项失败 " << sqlQuery.lastError();
-    else
-        qDebug() << "数据库:插入id为 " << id << " 的物品项成功 ";
+    Connection &conn = connection();
+    if (conn.groupLastBatch <= conn.groupSyncedBatch)
+        return true;
+    QMutexLocker locker(&groupMutex);
+    while (groupCommitted < conn.groupLastBatch)
+        groupDone.wait(&groupMutex);
+    bool flag = true;
+    for (quint64 batch : groupFailed)
+        if (batch > conn.groupSyncedBatch && batch <= conn.groupLastBatch)
+            flag = false;
+    conn.groupSyncedBatch = conn.groupLastBatch;
+    return flag;
 }
 
-QSharedPointer<Item> Database::query2Item(const QSqlQuery &sqlQuery) const
+bool Database::flushGroupCommit()
 {
-    Time sendingTime{sqlQuery.value(3).toInt(), sqlQuery.value(4).toInt(), sqlQuery.value(5).toInt()};
-    Time receivingTime{sqlQuery.value(6).toInt(), sqlQuery.value(7).toInt(), sqlQuery.value(8).toInt()};
-    return QSharedPointer<Item>::create(sqlQuery.value(0).toInt(), sqlQuery.value(1).toInt(), sqlQuery.value(2).toInt(), sendingTime, receivingTime, sqlQuery.value(9).toString(), sqlQuery.value(10).toString(), sqlQuery.value(11).toString());
+    if (!groupWriter)
+        return true;
+    GroupJob job;
+    {
+        QMutexLocker locker(&groupMutex);
+        groupQueue.enqueue(&job);
+        groupWake.wakeOne();
+        while (!job.done)
+            groupDone.wait(&groupMutex);
+    }
+    //之前收到的修改都已随这次提交结束, 这里不会再等待
+    bool flag = waitGroupCommit();
+    return job.result && flag;
 }
 
-int Database::queryItemByFilter(QList<QSharedPointer<Item>> &result, int id, const Time &sendingTime, const Time &receivingTime, const QString &srcName, const QString &dstName) const
+bool Database::snapshot(const QString &path)
 {
-    QSqlQuery sqlQuery(db);
-    QString queryString("SELECT * FROM item");
-    bool flag = false;
-    if (id != -1)
+    Connection &conn = connection();
+    if (!flushGroupCommit() || conn.transactionDepth > 0)
     {
-        queryString += QString(flag ? " AND " : " WHERE ") + "id = :id";
-        flag = true;
+        qCritical() << "数据库:事务未结束，不能保存快照";
+        return false;
     }
-    if (sendingTime.year != -1)
+
+    //VACUUM INTO要求目标文件不存在，先写临时文件再替换
+    QString tempPath = path + ".tmp";
+    QFile::remove(tempPath);
+    QSqlQuery sqlQuery(conn.db);
+    sqlQuery.prepare("VACUUM INTO :path");
+    sqlQuery.bindValue(":path", tempPath);
+    if (!exec(sqlQuery))
     {
-        queryString += QString(flag ? " AND " : " WHERE ") + "sendingTime_Year = :sendingTime_Year";
-        flag = true;
+        qCritical() << "数据库:保存快照" << path << "失败" << sqlQuery.lastError();
+        return false;
     }
-    if (sendingTime.month != -1)
+    QFile::remove(path);
+    if (!QFile::rename(tempPath, path))
     {
-        queryString += QString(flag ? " AND " : " WHERE ") + "sendingTime_Month = :sendingTime_Month";
-        flag = true;
+        qCritical() << "数据库:保存快照" << path << "失败，无法替换原文件";
+        return false;
     }
-    if (sendingTime.day != -1)
+    qDebug() << "数据库:保存快照" << path << "成功";
+    return true;
+}
+
+bool Database::restore(const QString &path)
+{
+    Connection &conn = connection();
+    if (!flushGroupCommit() || conn.transactionDepth > 0)
     {
-        queryString += QString(flag ? " AND " : " WHERE ") + "sendingTime_Day = :sendingTime_Day";
-        flag = true;
+        qCritical() << "数据库:事务未结束，不能恢复快照";
+        return false;
     }
-    if (receivingTime.year != -1)
+    //ATTACH不存在的文件会创建一个空数据库
+    if (!QFile::exists(path))
     {
-        queryString += QString(flag ? " AND " : " WHERE ") + "receivingTime_Year = :receivingTime_Year";
-        flag = true;
+        qCritical() << "数据库:快照" << path << "不存在";
+        return false;
     }
-    if (receivingTime.month != -1)
+
+    QSqlQuery attach(conn.db);
+    attach.prepare("ATTACH DATABASE :path AS snapshot");
+    attach.bindValue(":path", path);
+    if (!exec(attach))
     {
-        queryString += QString(flag ? " AND " : " WHERE ") + "receivingTime_Month = :receivingTime_Month";
-        flag = true;
+        qCritical() << "数据库:打开快照" << path << "失败" << attach.lastError();
+        return false;
     }
-    if (receivingTime.day != -1)
+
+    static const char *const statements[] = {
+        "DELETE FROM item",
+        "DELETE FROM user",
+        "INSERT INTO item(id, cost, state, sendingDate, receivingDate, srcName, dstName, description)"
+        " SELECT id, cost, state, sendingDate, receivingDate, srcName, dstName, description FROM snapshot.item",
+        "INSERT INTO user(username, password, type, balance, name, phoneNumber, address)"
+        " SELECT username, password, type, balance, name, phoneNumber, address FROM snapshot.user"};
+    bool flag = beginTransaction();
+    if (flag)
+        markItemDirty(-1);
+    for (const char *statement : statements)
     {
-        queryString += QString(flag ? " AND " : " WHERE ") + "receivingTime_Day = :receivingTime_Day";
-        flag = true;
+        if (!flag)
+            break;
+        QSqlQuery sqlQuery(conn.db);
+        flag = sqlQuery.exec(statement);
+        if (!flag)
+            qCritical() << "数据库:恢复快照失败" << statement << sqlQuery.lastError();
     }
-    if (!srcName.isEmpty())
+    if (flag)
+        flag = commitTransaction();
+    if (!flag)
+        rollbackTransaction();
+
+    QSqlQuery detach(conn.db);
+    if (!detach.exec("DETACH DATABASE snapshot"))
+        qCritical() << "数据库:关闭快照失败" << detach.lastError();
+    if (flag)
     {
-        queryString += QString(flag ? " AND " : " WHERE ") + "srcName = :srcName";
-        flag = true;
+        reservationEpoch.ref(); //恢复的物品可能占用了已预留的单号
+        qDebug() << "数据库:从快照" << path << "恢复成功";
     }
-    if (!dstName.isEmpty())
+    return flag;
+}
+
+bool Database::execInsertItem(int id, int cost, int state, const Time &sendingTime, const Time &receivingTime, const QString &srcName, const QString &dstName, const QString &description) const
+{
+    markItemDirty(id);
+    QSqlQuery &sqlQuery = prepareCached(QStringLiteral("INSERT INTO item VALUES(:id, :cost, :state,"
+                                                       " :sendingDate, :receivingDate,"
+                                                       " :srcName, :dstName, :description)")); // phase2开始添加type
+    sqlQuery.bindValue(":id", id);
+    sqlQuery.bindValue(":cost", cost);
+    sqlQuery.bindValue(":state", state);
+    sqlQuery.bindValue(":sendingDate", sendingTime.toOrdinal());
+    sqlQuery.bindValue(":receivingDate", receivingTime.toOrdinal());
+    sqlQuery.bindValue(":srcName", srcName);
+    sqlQuery.bindValue(":dstName", dstName);
+    sqlQuery.bindValue(":description", description);
+    if (!exec(sqlQuery))
+    {
+        qCritical() << "数据库:插入id为 " << id << " 的物品项失败 " << sqlQuery.lastError();
+        return false;
+    }
+    return true;
+}
+
+bool Database::insertItem(int id, int cost, int state, const Time &sendingTime, const Time &receivingTime, const QString &srcName, const QString &dstName, const QString &description)
+{
+    if (!groupWrite([&]
+                    { return execInsertItem(id, cost, state, sendingTime, receivingTime, srcName, dstName, description); }))
+        return false;
+    qDebug() << "数据库:插入id为 " << id << " 的物品项成功 ";
+    return true;
+}
+
+bool Database::insertItems(int firstId, const QVector<ItemDescriptor> &items)
+{
+    if (!beginTransaction())
+        return false;
+    int id = firstId;
+    for (const ItemDescriptor &item : items)
+        if (!execInsertItem(id++, item.cost, item.state, item.sendingTime, item.receivingTime, item.srcName, item.dstName, item.description))
+        {
+            rollbackTransaction();
+            return false;
+        }
+    if (!commitTransaction())
+    {
+        rollbackTransaction();
+        return false;
+    }
+    qDebug() << "数据库:批量插入id为 " << firstId << " 至 " << id - 1 << " 的物品项成功 ";
+    return true;
+}
+
+void Database::query2Item(const QSqlQuery &sqlQuery, ItemList &result)
+{
+    //直接在数组中构造，字符串只移动不复制
+    result.emplace_back(sqlQuery.value(0).toInt(), sqlQuery.value(1).toInt(), sqlQuery.value(2).toInt(), Time::fromOrdinal(sqlQuery.value(3).toInt()), Time::fromOrdinal(sqlQuery.value(4).toInt()), sqlQuery.value(5).toString(), sqlQuery.value(6).toString(), sqlQuery.value(7).toString());
+}
+
+Item Database::readItem(const QSqlQuery &sqlQuery)
+{
+    return Item(sqlQuery.value(0).toInt(), sqlQuery.value(1).toInt(), sqlQuery.value(2).toInt(), Time::fromOrdinal(sqlQuery.value(3).toInt()), Time::fromOrdinal(sqlQuery.value(4).toInt()), sqlQuery.value(5).toString(), sqlQuery.value(6).toString(), sqlQuery.value(7).toString());
+}
+
+int Database::itemFilterMask(const ItemFilter &filter)
+{
+    return (filter.id != -1) << 0 |
+           (filter.sendingFrom.year != -1) << 1 |
+           (filter.sendingTo.year != -1) << 2 |
+           (filter.receivingFrom.year != -1) << 3 |
+           (filter.receivingTo.year != -1) << 4 |
+           (!filter.srcName.isEmpty()) << 5 |
+           (!filter.dstName.isEmpty()) << 6 |
+           (filter.afterId != -1) << 7 |
+           filter.descending << 8 |
+           (filter.limit > 0) << 9 |
+           (filter.sendingMonth != -1) << 10 |
+           (filter.sendingDay != -1) << 11 |
+           (filter.receivingMonth != -1) << 12 |
+           (filter.receivingDay != -1) << 13;
+}
+
+QString Database::itemFilterCondition(int mask)
+{
+    //未接收的物品receivingDate为-1，接收时间上限不应包含它们
+    static const char *const conditions[] = {"id = :id",
+                                             "sendingDate >= :sendingFrom",
+                                             "sendingDate <= :sendingTo",
+                                             "receivingDate >= :receivingFrom",
+                                             "receivingDate BETWEEN 0 AND :receivingTo",
+                                             "srcName = :srcName",
+                                             "dstName = :dstName"};
+    //单独的月、日条件从整数日期中取出(见Time::fromOrdinal)，不能用索引，只过滤其他条件选出的行
+    static const char *const monthDayConditions[] = {"(sendingDate / 31) % 12 + 1 = :sendingMonth",
+                                                     "sendingDate % 31 + 1 = :sendingDay",
+                                                     "receivingDate >= 0 AND (receivingDate / 31) % 12 + 1 = :receivingMonth",
+                                                     "receivingDate >= 0 AND receivingDate % 31 + 1 = :receivingDay"};
+    QString condition;
+    for (int i = 0; i < 7; i++)
+        if (mask & (1 << i))
+            condition += QString(condition.isEmpty() ? " WHERE " : " AND ") + conditions[i];
+    for (int i = 0; i < 4; i++)
+        if (mask & (1 << (i + 10)))
+            condition += QString(condition.isEmpty() ? " WHERE " : " AND ") + monthDayConditions[i];
+
+    //分页: 游标是上一页最后一个单号，按主键顺序继续读取，不使用OFFSET
+    const bool descending = mask & (1 << 8);
+    if (mask & (1 << 7))
+        condition += QString(condition.isEmpty() ? " WHERE " : " AND ") + (descending ? "id < :afterId" : "id > :afterId");
+    if (mask & (7 << 7))
+        condition += descending ? " ORDER BY id DESC" : " ORDER BY id";
+    if (mask & (1 << 9))
+        condition += " LIMIT :limit";
+    return condition;
+}
+
+void Database::bindItemFilter(QSqlQuery &sqlQuery, const ItemFilter &filter)
+{
+    if (filter.id != -1)
+        sqlQuery.bindValue(":id", filter.id);
+    if (filter.sendingFrom.year != -1)
+        sqlQuery.bindValue(":sendingFrom", filter.sendingFrom.toOrdinal());
+    if (filter.sendingTo.year != -1)
+        sqlQuery.bindValue(":sendingTo", filter.sendingTo.toOrdinal());
+    if (filter.receivingFrom.year != -1)
+        sqlQuery.bindValue(":receivingFrom", filter.receivingFrom.toOrdinal());
+    if (filter.receivingTo.year != -1)
+        sqlQuery.bindValue(":receivingTo", filter.receivingTo.toOrdinal());
+    if (!filter.srcName.isEmpty())
+        sqlQuery.bindValue(":srcName", filter.srcName);
+    if (!filter.dstName.isEmpty())
+        sqlQuery.bindValue(":dstName", filter.dstName);
+    if (filter.sendingMonth != -1)
+        sqlQuery.bindValue(":sendingMonth", filter.sendingMonth);
+    if (filter.sendingDay != -1)
+        sqlQuery.bindValue(":sendingDay", filter.sendingDay);
+    if (filter.receivingMonth != -1)
+        sqlQuery.bindValue(":receivingMonth", filter.receivingMonth);
+    if (filter.receivingDay != -1)
+        sqlQuery.bindValue(":receivingDay", filter.receivingDay);
+    if (filter.afterId != -1)
+        sqlQuery.bindValue(":afterId", filter.afterId);
+    if (filter.limit > 0)
+        sqlQuery.bindValue(":limit", filter.limit);
+}
+
+QSqlQuery &Database::prepareItemFilter(int mask, ItemProjection projection) const
+{
+    Connection &conn = connection();
+    static const char *const columns[] = {"id, cost, state, sendingDate, receivingDate, srcName, dstName, description",
+                                          "id",
+                                          "COUNT(*)"};
+    //计数只有一行结果，行数限制没有意义；排序方向只在给出游标时决定计数的是游标哪一侧
+    if (projection == COUNT_ONLY)
+        mask &= (mask & (1 << 7)) ? ~(1 << 9) : ~(3 << 8);
+
+    //每个条件占一位，11个可选条件和3个分页选项最多对应16384种语句，再乘以3种查询列，每种只编译一次(实际用到的很少)
+    QSharedPointer<QSqlQuery> &cached = conn.filterStatementCache[mask | projection << 14];
+    if (!cached)
     {
-        queryString += QString(flag ? " AND " : " WHERE ") + "dstName = :dstName";
-        flag = true;
+        QString queryString(QString("SELECT ") + columns[projection] + " FROM item" + itemFilterCondition(mask));
+        cached = QSharedPointer<QSqlQuery>::create(conn.db);
+        cached->setForwardOnly(true);
+        if (!cached->prepare(queryString))
+            qCritical() << "数据库:预编译" << queryString << "失败" << cached->lastError();
     }
-    sqlQuery.prepare(queryString);
+    return *cached;
+}
 
-    if (id != -1)
-        sqlQuery.bindValue(":id", id);
-    if (sendingTime.year != -1)
-        sqlQuery.bindValue(":sendingTime_Year", sendingTime.year);
-    if (sendingTime.month != -1)
-        sqlQuery.bindValue(":sendingTime_Month", sendingTime.month);
-    if (sendingTime.day != -1)
-        sqlQuery.bindValue(":sendingTime_Day", sendingTime.day);
-    if (receivingTime.year != -1)
-        sqlQuery.bindValue(":receivingTime_Year", receivingTime.year);
-    if (receivingTime.month != -1)
-        sqlQuery.bindValue(":receivingTime_Month", receivingTime.month);
-    if (receivingTime.day != -1)
-        sqlQuery.bindValue(":receivingTime_Day", receivingTime.day);
-    if (!srcName.isEmpty())
-        sqlQuery.bindValue(":srcName", srcName);
-    if (!dstName.isEmpty())
-        sqlQuery.bindValue(":dstName", dstName);
+int Database::queryItemByFilter(ItemList &result, const ItemFilter &filter) const
+{
+    //SQLite不提供结果行数，只在语句能确定行数上限时预留；limit来自调用者，预留量有上限
+    if (filter.id != -1)
+        result.reserve(result.size() + 1);
+    else if (filter.limit > 0)
+        result.reserve(result.size() + qMin(filter.limit, MAX_RESERVE_ROWS));
+
+    return visitItemRows(filter, [&result](const QSqlQuery &sqlQuery)
+                         {
+                             query2Item(sqlQuery, result);
+                             return true;
+                         });
+}
+
+int Database::visitItemByFilter(const ItemFilter &filter, const std::function<bool(const Item &)> &visitor) const
+{
+    //每行只构造一个临时Item对象，交给visitor后即销毁
+    return visitItemRows(filter, [&visitor](const QSqlQuery &sqlQuery)
+                         { return visitor(readItem(sqlQuery)); });
+}
 
-    exec(sqlQuery);
-    if (!sqlQuery.exec())
+int Database::visitItemRows(const ItemFilter &filter, const std::function<bool(const QSqlQuery &)> &rowVisitor, ItemProjection projection) const
+{
+    QSqlQuery &sqlQuery = prepareItemFilter(itemFilterMask(filter), projection);
+    bindItemFilter(sqlQuery, filter);
+
+    if (!exec(sqlQuery))
     {
         qCritical() << "数据库:查找物品失败" << sqlQuery.lastError();
         return 0;
     }
-    else
+
+    int cnt = 0;
+    while (sqlQuery.next())
     {
-        int cnt = 0;
-        while (sqlQuery.next())
-        {
-            result.append(query2Item(sqlQuery)); //将查找结果转换为临时Item对象
-            cnt++;
-        }
-        qDebug() << "数据库:查找物品成功，共" << cnt << "条";
-        return cnt;
+        cnt++;
+        if (!rowVisitor(sqlQuery))
+            break;
     }
+    sqlQuery.finish();
+    qDebug() << "数据库:查找物品成功，共" << cnt << "条";
+    return cnt;
+}
+
+int Database::countItemByFilter(const ItemFilter &filter) const
+{
+    int cnt = -1;
+    ItemFilter countFilter = filter;
+    countFilter.limit = -1;
+    visitItemRows(countFilter, [&cnt](const QSqlQuery &sqlQuery)
+                  {
+                      cnt = sqlQuery.value(0).toInt();
+                      return false;
+                  },
+                  COUNT_ONLY);
+    return cnt;
+}
+
+int Database::queryItemIdByFilter(QVector<int> &ids, const ItemFilter &filter) const
+{
+    if (filter.limit > 0)
+        ids.reserve(ids.size() + qMin(filter.limit, MAX_RESERVE_ROWS));
+    return visitItemRows(filter, [&ids](const QSqlQuery &sqlQuery)
+                         {
+                             ids.append(sqlQuery.value(0).toInt());
+                             return true;
+                         },
+                         ID_ONLY);
+}
+
+int Database::aggregateItemByFilter(QVector<ItemAggregate> &result, const ItemFilter &filter, int groupBy) const
+{
+    static const char *const groupColumns[] = {"srcName", "state", "sendingDate"};
+    QStringList columns;
+    for (int i = 0; i < 3; i++)
+        if (groupBy & (1 << i))
+            columns.append(groupColumns[i]);
+
+    //分组统计不分页，去掉游标、排序和行数限制
+    QString queryString("SELECT " + (columns.isEmpty() ? QString() : columns.join(", ") + ", ") + "COUNT(*), IFNULL(SUM(cost), 0) FROM item" + itemFilterCondition(itemFilterMask(filter) & ~(7 << 7)));
+    if (!columns.isEmpty())
+        queryString += " GROUP BY " + columns.join(", ") + " ORDER BY " + columns.join(", ");
+
+    QSqlQuery &sqlQuery = prepareCached(queryString);
+    bindItemFilter(sqlQuery, filter);
+    if (!exec(sqlQuery))
+    {
+        qCritical() << "数据库:统计物品失败" << sqlQuery.lastError();
+        return -1;
+    }
+
+    int cnt = 0;
+    while (sqlQuery.next())
+    {
+        ItemAggregate row;
+        int column = 0;
+        if (groupBy & GROUP_BY_SRC_NAME)
+            row.srcName = sqlQuery.value(column++).toString();
+        if (groupBy & GROUP_BY_STATE)
+            row.state = sqlQuery.value(column++).toInt();
+        if (groupBy & GROUP_BY_SENDING_DATE)
+            row.sendingTime = Time::fromOrdinal(sqlQuery.value(column++).toInt());
+        row.count = sqlQuery.value(column++).toInt();
+        row.revenue = sqlQuery.value(column).toLongLong();
+        result.append(row);
+        cnt++;
+    }
+    sqlQuery.finish();
+    qDebug() << "数据库:统计物品成功，共" << cnt << "组";
+    return cnt;
+}
+
+QStringList Database::explainItemFilter(const ItemFilter &filter) const
+{
+    Connection &conn = connection();
+    //查询计划与参数的值无关，不需要绑定
+    QStringList plan;
+    QSqlQuery sqlQuery(conn.db);
+    sqlQuery.prepare("EXPLAIN QUERY PLAN SELECT * FROM item" + itemFilterCondition(itemFilterMask(filter)));
+    if (!exec(sqlQuery))
+    {
+        qCritical() << "数据库:获取查询计划失败" << sqlQuery.lastError();
+        return plan;
+    }
+    while (sqlQuery.next())
+        plan.append(sqlQuery.value("detail").toString());
+    return plan;
 }
 
 bool Database::modifyItemState(const int id, const int state)
 {
-    return modifyData("item", QString::number(id), "state", state);
+    return groupWrite([&]
+                      {
+                          markItemDirty(id);
+                          return modifyData("item", QString::number(id), "state", state);
+                      });
 }
 
 bool Database::modifyItemReceivingTime(const int id, const Time receivingTime)
 {
-    bool flag1 = false, flag2 = false, flag3 = false;
-    flag1 = modifyData("item", QString::number(id), "receivingTime_Year", receivingTime.year);
-    flag2 = modifyData("item", QString::number(id), "receivingTime_Month", receivingTime.month);
-    flag2 = modifyData("item", QString::number(id), "receivingTime_Day", receivingTime.day);
-    return flag1 && flag2 && flag3;
+    return groupWrite([&]
+                      {
+                          markItemDirty(id);
+                          return modifyData("item", QString::number(id), "receivingDate", receivingTime.toOrdinal());
+                      });
 }
 
-bool Database::deleteItem(const int id) const
+int Database::markItemReceived(const int id, const Time &receivingTime)
 {
-    QSqlQuery sqlQuery(db);
-    sqlQuery.prepare("DELETE FROM item WHERE id = :id");
-    sqlQuery.bindValue(":id", id);
-    exec(sqlQuery);
-    if (!sqlQuery.exec())
+    //语句在执行修改的连接上编译, 组提交模式下是写线程的连接
+    int changed = 0;
+    if (!groupWrite([&]
+                    {
+                        markItemDirty(id);
+                        //以state作为条件，重复签收不会修改任何行
+                        QSqlQuery &sqlQuery = prepareCached(QStringLiteral("UPDATE item SET state = :received, receivingDate = :receivingDate WHERE id = :id AND state = :pending"));
+                        sqlQuery.bindValue(":received", RECEIVED);
+                        sqlQuery.bindValue(":receivingDate", receivingTime.toOrdinal());
+                        sqlQuery.bindValue(":id", id);
+                        sqlQuery.bindValue(":pending", PENDING_REVEICING);
+                        if (!exec(sqlQuery))
+                        {
+                            qCritical() << "数据库:签收物品" << id << "失败" << sqlQuery.lastError();
+                            return false;
+                        }
+                        changed = sqlQuery.numRowsAffected();
+                        return true;
+                    }))
+        return -1;
+    return changed;
+}
+
+bool Database::deleteItem(const int id)
+{
+    if (!groupWrite([&]
+                    {
+                        markItemDirty(id);
+                        QSqlQuery &sqlQuery = prepareCached(QStringLiteral("DELETE FROM item WHERE id = :id"));
+                        sqlQuery.bindValue(":id", id);
+                        return exec(sqlQuery);
+                    }))
     {
         qCritical() << "数据库删除id为 " << id << " 的项失败";
         return false;
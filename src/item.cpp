@@ -12,9 +12,25 @@
 #include "../include/item.h"
 #include "../include/database.h"
 
-ItemManage::ItemManage(Database *_db) : db(_db)
+ItemManage::ItemManage(Database *_db, int cacheSize) : db(_db), itemCache(cacheSize)
 {
-    total = db->getDBMaxId("item");
+}
+
+int ItemManage::allocateId()
+{
+    IdBlock &block = idBlocks.localData();
+    if (block.next >= block.end || block.epoch != db->getReservationEpoch())
+    {
+        //预留之后若事务回滚，sequence表可能已恢复原值，剩余的单号不能再用
+        int epoch = db->getReservationEpoch();
+        int first = db->reserveItemIds(ID_BLOCK_SIZE);
+        if (first < 0)
+            return -1;
+        block.next = first;
+        block.end = first + ID_BLOCK_SIZE;
+        block.epoch = epoch;
+    }
+    return block.next++;
 }
 
 int ItemManage::insertItem(
@@ -27,46 +43,144 @@ int ItemManage::insertItem(
     const QString &description)
 {
     qDebug() << "添加物品 ";
-    db->insertItem(++total, cost, state, sendingTime, receivingTime, srcName, dstName, description);
-    return total;
+    int id = allocateId();
+    if (id < 0 || !db->insertItem(id, cost, state, sendingTime, receivingTime, srcName, dstName, description))
+        return -1;
+    return id;
 }
 
-int ItemManage::queryAll(QList<QSharedPointer<Item>> &result) const
+bool ItemManage::insertItems(const QVector<ItemDescriptor> &items, QVector<int> &ids)
+{
+    qDebug() << "批量添加物品" << items.size() << "件";
+    //批量插入需要连续的单号，直接预留，不占用线程的预留
+    int first = db->reserveItemIds(items.size());
+    if (first < 0 || !db->insertItems(first, items))
+        return false;
+    ids.reserve(ids.size() + items.size());
+    for (int i = 0; i < items.size(); i++)
+        ids.append(first + i);
+    return true;
+}
+
+int ItemManage::queryAll(ItemList &result) const
 {
     qDebug() << "查询所有物品";
-    return db->queryItemByFilter(result, -1, Time(-1, -1, -1), Time(-1, -1, -1), "", "");
+    return db->queryItemByFilter(result, ItemFilter());
 }
 
-int ItemManage::queryByFilter(QList<QSharedPointer<Item>> &result,const  int id, const Time &sendingTime, const Time &receivingTime, const QString &srcName, const QString &dstName) const
+int ItemManage::queryByFilter(ItemList &result, const ItemFilter &filter) const
 {
     qDebug() << "按条件查询";
-    return db->queryItemByFilter(result, id, sendingTime, receivingTime, srcName, dstName);
+    return db->queryItemByFilter(result, filter);
 }
 
-bool ItemManage::queryById(QSharedPointer<Item> &result, const int id) const
+int ItemManage::visitByFilter(const ItemFilter &filter, const std::function<bool(const Item &)> &visitor) const
 {
-    QList<QSharedPointer<Item>> temp;
-    if (db->queryItemByFilter(temp, id, Time(-1, -1, -1), Time(-1, -1, -1), "", ""))
+    qDebug() << "按条件逐行查询";
+    return db->visitItemByFilter(filter, visitor);
+}
+
+bool ItemManage::queryById(ItemList &result, const int id) const
+{
+    //这个物品有未提交的修改时查到的可能是其他连接中修改前的旧值, 或本连接中尚未提交的值, 都不能放入缓存
+    int epoch = db->getCacheEpoch(id);
+    int version;
     {
-        result = temp[0];
-        return true;
+        QMutexLocker locker(&cacheMutex);
+        if (const Item *cached = itemCache.object(id))
+        {
+            cacheHits.ref();
+            result.push_back(*cached);
+            return true;
+        }
+        version = cacheVersion;
     }
-    else
+    cacheMisses.ref();
+
+    //查询数据库时不持有锁; 期间若有修改使缓存失效，查到的可能是旧值，不放入缓存
+    ItemFilter filter;
+    filter.id = id;
+    if (db->queryItemByFilter(result, filter) == 0)
         return false;
+    QMutexLocker locker(&cacheMutex);
+    if (version == cacheVersion && epoch != -1 && db->getCacheEpoch(id) == epoch)
+        itemCache.insert(id, new Item(result.back()));
+    return true;
+}
+
+void ItemManage::invalidate(const int id) const
+{
+    QMutexLocker locker(&cacheMutex);
+    cacheVersion++;
+    if (id == -1)
+        itemCache.clear();
+    else
+        itemCache.remove(id);
+}
+
+int ItemManage::countByFilter(const ItemFilter &filter) const
+{
+    return db->countItemByFilter(filter);
+}
+
+int ItemManage::idsByFilter(QVector<int> &ids, const ItemFilter &filter) const
+{
+    return db->queryItemIdByFilter(ids, filter);
+}
+
+int ItemManage::aggregateByFilter(QVector<ItemAggregate> &result, const ItemFilter &filter, int groupBy) const
+{
+    qDebug() << "按条件统计";
+    return db->aggregateItemByFilter(result, filter, groupBy);
+}
+
+QStringList ItemManage::explainByFilter(const ItemFilter &filter) const
+{
+    return db->explainItemFilter(filter);
 }
 
 bool ItemManage::modifyState(const int id, const int state)
 {
-    return db->modifyItemState(id, state);
+    bool flag = db->modifyItemState(id, state);
+    invalidate(id);
+    return flag;
 }
 
 bool ItemManage::modifyReceivingTime(const int id, const Time &receivingTime)
 {
-    return db->modifyItemReceivingTime(id, receivingTime);
+    bool flag = db->modifyItemReceivingTime(id, receivingTime);
+    invalidate(id);
+    return flag;
+}
+
+int ItemManage::markReceived(const int id, const Time &receivingTime)
+{
+    int changed = db->markItemReceived(id, receivingTime);
+    invalidate(id);
+    return changed;
+}
+
+bool ItemManage::sync() const
+{
+    if (db->waitGroupCommit())
+        return true;
+    //组事务提交失败时其中的修改都被丢弃，缓存可能含有这些修改
+    invalidate(-1);
+    return false;
+}
+
+bool ItemManage::restore(const QString &path)
+{
+    if (!db->restore(path))
+        return false;
+    invalidate(-1);
+    return true;
 }
 
 bool ItemManage::deleteItem(const int id) const
 {
     qDebug() << "删除id为" << id << "的物品";
-    return db->deleteItem(id);
+    bool flag = db->deleteItem(id);
+    invalidate(id);
+    return flag;
 }
\ No newline at end of file
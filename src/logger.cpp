@@ -0,0 +1,240 @@
+﻿/**
+ * @file logger.cpp
+ * @author Haolin Yang
+ * @brief 异步日志的实现
+ * @version 0.1
+ * @date 2022-04-10
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+
+#include "../include/logger.h"
+
+#define ANSI_COLOR_RED "\x1b[31m"
+#define ANSI_COLOR_GREEN "\x1b[32m"
+#define ANSI_COLOR_YELLOW "\x1b[33m"
+#define ANSI_COLOR_BLUE "\x1b[34m"
+#define ANSI_COLOR_MAGENTA "\x1b[35m"
+#define ANSI_COLOR_CYAN "\x1b[36m"
+#define ANSI_COLOR_WHITE "\x1b[37m"
+#define ANSI_COLOR_RESET "\x1b[0m"
+
+QAtomicPointer<Logger> Logger::current;
+
+Logger::Logger(const QString &fileName, int capacity)
+{
+    quint32 size = 2;
+    while (size < quint32(capacity))
+        size <<= 1;
+    mask = size - 1;
+    cells.reset(new Cell[size]);
+    for (quint32 i = 0; i < size; i++)
+        cells[i].sequence.storeRelaxed(i);
+
+    if (!fileName.isEmpty())
+    {
+        logStream = fopen(fileName.toLocal8Bit().constData(), "a");
+        if (!logStream)
+            fprintf(stderr, "无法打开日志文件 %s, 日志写到stdout\n", fileName.toLocal8Bit().constData());
+    }
+
+    writer.reset(QThread::create([this]()
+                                 { run(); }));
+    writer->start();
+    current.storeRelease(this);
+    qInstallMessageHandler(messageHandler);
+}
+
+Logger::~Logger()
+{
+    qInstallMessageHandler(nullptr);
+    current.storeRelease(nullptr);
+    stopping.storeRelease(1);
+    wakeup.release();
+    writer->wait();
+    if (logStream)
+        fclose(logStream);
+}
+
+void Logger::messageHandler(QtMsgType type, const QMessageLogContext &context, const QString &msg)
+{
+    //依次为Debug, Warning, Critical, Fatal, Info, 与QtMsgType的值对应
+    static const char *const colorPrefixes[] = {ANSI_COLOR_BLUE "[Debug]", ANSI_COLOR_MAGENTA "[Warning]", ANSI_COLOR_RED "[Critical]", ANSI_COLOR_RED "[Fatal]", ANSI_COLOR_YELLOW "[Info]"};
+    static const char *const prefixes[] = {"[Debug]", "[Warning]", "[Critical]", "[Fatal]", "[Info]"};
+
+    Logger *logger = current.loadAcquire();
+    bool plain = logger && logger->plain.loadRelaxed();
+    FILE *logStream = logger ? logger->logStream : nullptr;
+    FILE *stream = logStream ? logStream : plain ? stderr : stdout;
+
+    QByteArray text;
+    if (plain)
+        text = msg.toLocal8Bit();
+    else
+    {
+        const char *file = context.file ? context.file : "";
+        //写到日志文件时不加颜色
+        if (stream == logStream)
+            text = QByteArray(prefixes[type]) + "(" + file + ":" + QByteArray::number(context.line) + ") " + msg.toLocal8Bit();
+        else
+            text = QByteArray(colorPrefixes[type]) + ANSI_COLOR_CYAN "(" + file + ":" + QByteArray::number(context.line) + ")" ANSI_COLOR_RESET " " + msg.toLocal8Bit();
+    }
+    text += '\n';
+
+    //Fatal之后程序立即退出, 先写出之前的消息, 再直接同步写出
+    if (type == QtFatalMsg && logger)
+        flush();
+    if (type == QtFatalMsg || !logger)
+    {
+        fwrite(text.constData(), 1, text.size(), stream);
+        fflush(stream);
+        return;
+    }
+    logger->push(std::move(text), stream, false);
+}
+
+void Logger::writeResult(const QString &text)
+{
+    QByteArray line = text.toLocal8Bit() + '\n';
+    Logger *logger = current.loadAcquire();
+    if (!logger)
+    {
+        fwrite(line.constData(), 1, line.size(), stdout);
+        fflush(stdout);
+        return;
+    }
+    logger->push(std::move(line), stdout, true);
+}
+
+void Logger::flush()
+{
+    Logger *logger = current.loadAcquire();
+    if (!logger)
+        return;
+    //调用前放入的消息都在target之前，后台线程按顺序写出，越过target即全部写出
+    quint32 target = logger->pushPos.loadAcquire();
+    while (qint32(logger->flushed.loadAcquire() - target) < 0)
+    {
+        if (logger->waiting.testAndSetOrdered(1, 0))
+            logger->wakeup.release();
+        QThread::yieldCurrentThread();
+    }
+}
+
+bool Logger::push(QByteArray &&text, FILE *stream, bool wait)
+{
+    quint32 pos = pushPos.loadRelaxed();
+    Cell *cell;
+    while (true)
+    {
+        cell = &cells[pos & mask];
+        qint32 diff = qint32(cell->sequence.loadAcquire() - pos);
+        if (diff == 0)
+        {
+            //占到这一格; 失败时pos被更新为当前的写入位置
+            if (pushPos.testAndSetRelaxed(pos, pos + 1, pos))
+                break;
+        }
+        else if (diff < 0 && wait)
+        {
+            //缓冲区已满, 后台线程正在写出, 让出时间片后重试
+            QThread::yieldCurrentThread();
+            pos = pushPos.loadRelaxed();
+        }
+        else if (diff < 0)
+        {
+            //这一格还没被读走, 缓冲区已满
+            dropped.fetchAndAddRelaxed(1);
+            return false;
+        }
+        else
+            pos = pushPos.loadRelaxed();
+    }
+    cell->text = std::move(text);
+    cell->stream = stream;
+    cell->sequence.storeRelease(pos + 1);
+
+    if (waiting.testAndSetOrdered(1, 0))
+        wakeup.release();
+    return true;
+}
+
+bool Logger::pop(QByteArray &text, FILE *&stream)
+{
+    if (isEmpty())
+        return false;
+    Cell &cell = cells[popPos & mask];
+    text = std::move(cell.text);
+    stream = cell.stream;
+    cell.sequence.storeRelease(popPos + mask + 1);
+    popPos++;
+    return true;
+}
+
+bool Logger::isEmpty() const
+{
+    return qint32(cells[popPos & mask].sequence.loadAcquire() - (popPos + 1)) < 0;
+}
+
+void Logger::run()
+{
+    QByteArray text;
+    FILE *stream = nullptr;
+    int reportedDrops = 0;
+    while (true)
+    {
+        int count = 0;
+        while (count < WRITE_BATCH && pop(text, stream))
+        {
+            fwrite(text.constData(), 1, text.size(), stream);
+            count++;
+        }
+        int drops = dropped.loadRelaxed();
+        if (drops != reportedDrops)
+        {
+            fprintf(logStream ? logStream : plain.loadRelaxed() ? stderr : stdout, "[Logger] 日志缓冲区已满，共丢弃%d条日志\n", drops);
+            reportedDrops = drops;
+            count++;
+        }
+        if (count > 0)
+        {
+            fflush(nullptr);
+            flushed.storeRelease(popPos);
+            continue;
+        }
+        if (stopping.loadAcquire())
+            break;
+        //先声明在等待再检查一次, 避免错过声明之前放入的消息; 超时兜底
+        waiting.fetchAndStoreOrdered(1);
+        if (isEmpty())
+            wakeup.tryAcquire(1, 100);
+        waiting.storeRelease(0);
+    }
+}
+
+void Logger::setLevels(const QString &levels)
+{
+    //依次为debug, info, warning, critical是否输出
+    static const QHash<QString, QVector<bool>> switches{
+        {"debug", {true, true, true, true}},
+        {"info", {false, true, true, true}},
+        {"warning", {false, false, true, true}},
+        {"critical", {false, false, false, true}},
+        {"none", {false, false, false, false}}};
+    static const char *const types[] = {"debug", "info", "warning", "critical"};
+    QStringList rules;
+    for (const QString &rule : levels.split(',', Qt::SkipEmptyParts))
+    {
+        QStringList pair = rule.split('=');
+        QString level = pair.size() == 2 ? pair[1].trimmed().toLower() : QString();
+        if (!switches.contains(level))
+        {
+            qWarning() << "日志级别规则有误" << rule;
+            continue;
+        }
+        for (int i = 0; i < 4; i++)
+            rules.append(QString("%1.%2=%3").arg(pair[0].trimmed(), types[i], switches[level][i] ? "true" : "false"));
+    }
+    QLoggingCategory::setFilterRules(rules.join('\n'));
+}
@@ -0,0 +1,180 @@
+﻿/**
+ * @file request.cpp
+ * @author Haolin Yang
+ * @brief Json请求处理的实现
+ * @version 0.1
+ * @date 2022-04-10
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+
+#include "../include/request.h"
+
+const QString RequestHandler::NOT_LOGGED_IN = "当前没有用户登录，请登录后重试。";
+const QString RequestHandler::LOGGED_IN = "当前已有用户登录，请登出后重试。";
+
+const QHash<QString, RequestHandler::Operation> &RequestHandler::operations()
+{
+    //除register/login/time外的操作都需要先登录, 在handle中统一检查
+    static const QHash<QString, Operation> table{
+        {"register", {MUTATING, [](UserManage &userManage, const QJsonObject &request, QJsonValue &token, QJsonValue &) -> QString
+         { return registerUser(userManage, token, request["username"].toString(), request["password"].toString(),
+                               request["name"].toString(), request["phoneNumber"].toString(), request["address"].toString()); }}},
+        {"login", {0, [](UserManage &userManage, const QJsonObject &request, QJsonValue &token, QJsonValue &) -> QString
+         { return login(userManage, token, request["username"].toString(), request["password"].toString()); }}},
+        {"logout", {0, [](UserManage &userManage, const QJsonObject &, QJsonValue &token, QJsonValue &) -> QString
+         { return logout(userManage, token); }}},
+        {"changePassword", {MUTATING, [](UserManage &userManage, const QJsonObject &request, QJsonValue &token, QJsonValue &) -> QString
+         { return userManage.changePassword(token.toObject(), request["password"].toString()); }}},
+        {"getUserInfo", {0, [](UserManage &userManage, const QJsonObject &, QJsonValue &token, QJsonValue &result) -> QString
+         {
+             QJsonObject retInfo;
+             QString ret = userManage.getUserInfo(token.toObject(), retInfo);
+             result = retInfo;
+             return ret;
+         }}},
+        {"queryAllUserInfo", {0, [](UserManage &userManage, const QJsonObject &, QJsonValue &token, QJsonValue &result) -> QString
+         {
+             QJsonArray retInfo;
+             QString ret = userManage.queryAllUserInfo(token.toObject(), retInfo);
+             result = retInfo;
+             return ret;
+         }}},
+        {"addBalance", {MUTATING, [](UserManage &userManage, const QJsonObject &request, QJsonValue &token, QJsonValue &) -> QString
+         {
+             if (!request["amount"].isDouble())
+                 return "缺少充值金额";
+             return userManage.addBalance(token.toObject(), request["amount"].toInt());
+         }}},
+        {"queryItem", {0, [](UserManage &userManage, const QJsonObject &request, QJsonValue &token, QJsonValue &result) -> QString
+         {
+             QJsonArray retItems;
+             QString ret = userManage.queryItem(token.toObject(), request["filter"].toObject(), retItems);
+             result = retItems;
+             return ret;
+         }}},
+        {"countItem", {0, [](UserManage &userManage, const QJsonObject &request, QJsonValue &token, QJsonValue &result) -> QString
+         {
+             int cnt = 0;
+             QString ret = userManage.countItem(token.toObject(), request["filter"].toObject(), cnt);
+             result = cnt;
+             return ret;
+         }}},
+        {"aggregateItem", {0, [](UserManage &userManage, const QJsonObject &request, QJsonValue &token, QJsonValue &result) -> QString
+         {
+             QJsonArray retStats;
+             QString ret = userManage.aggregateItem(token.toObject(), request["filter"].toObject(), retStats);
+             result = retStats;
+             return ret;
+         }}},
+        {"explainItemQuery", {0, [](UserManage &userManage, const QJsonObject &request, QJsonValue &token, QJsonValue &result) -> QString
+         {
+             QStringList plan;
+             QString ret = userManage.explainItemQuery(token.toObject(), request["filter"].toObject(), plan);
+             result = QJsonArray::fromStringList(plan);
+             return ret;
+         }}},
+        {"sendItem", {MUTATING, [](UserManage &userManage, const QJsonObject &request, QJsonValue &token, QJsonValue &) -> QString
+         {
+             QJsonObject info;
+             info.insert("dstName", request["dstName"]);
+             info.insert("description", request["description"]);
+             return userManage.sendItem(token.toObject(), info);
+         }}},
+        {"receiveItem", {MUTATING, [](UserManage &userManage, const QJsonObject &request, QJsonValue &token, QJsonValue &) -> QString
+         {
+             QJsonObject info;
+             info.insert("id", request["itemId"]);
+             return userManage.receiveItem(token.toObject(), info);
+         }}},
+        {"snapshot", {NO_TRANSACTION, [](UserManage &userManage, const QJsonObject &request, QJsonValue &token, QJsonValue &) -> QString
+         { return userManage.snapshot(token.toObject(), request["path"].toString()); }}},
+        {"restore", {NO_TRANSACTION, [](UserManage &userManage, const QJsonObject &request, QJsonValue &token, QJsonValue &) -> QString
+         { return restore(userManage, token, request["path"].toString()); }}},
+        {"time", {0, [](UserManage &, const QJsonObject &, QJsonValue &, QJsonValue &result) -> QString
+         {
+             QJsonObject retTime;
+             QString ret = Time::getTime(retTime);
+             result = retTime;
+             return ret;
+         }}}};
+    return table;
+}
+
+QJsonObject RequestHandler::handle(const QJsonObject &request, QJsonValue &token) const
+{
+    QJsonObject response;
+    if (request.contains("id"))
+        response.insert("id", request["id"]);
+
+    QString op = request["op"].toString();
+    Handler handler = operations().value(op, {0, nullptr}).run;
+    QString ret;
+    QJsonValue result(QJsonValue::Undefined); //没有结果的操作不设置
+    if (!handler)
+        ret = "未知的操作 " + op;
+    else if (token.isNull() && op != "register" && op != "login" && op != "time")
+        ret = NOT_LOGGED_IN;
+    else
+        ret = handler(*userManage, request, token, result);
+    //因凭据作废而失败的操作清空凭据, 之后的请求直接返回未登录
+    if (!ret.isEmpty() && !token.isNull())
+        expireToken(*userManage, token);
+
+    response.insert("ok", ret.isEmpty());
+    if (!ret.isEmpty())
+        response.insert("error", ret);
+    else if (!result.isUndefined())
+        response.insert("result", result);
+    return response;
+}
+
+QString RequestHandler::registerUser(UserManage &userManage, QJsonValue &token, const QString &username, const QString &password, const QString &name, const QString &phoneNumber, const QString &address)
+{
+    //其他会话恢复快照时清空了所有会话, 之前的凭据作废, 回到未登录状态后可以直接注册或登录
+    if (!token.isNull())
+        expireToken(userManage, token);
+    if (!token.isNull())
+        return LOGGED_IN;
+    return userManage.registerUser(username, password, CUSTOMER, name, phoneNumber, address);
+}
+
+QString RequestHandler::login(UserManage &userManage, QJsonValue &token, const QString &username, const QString &password)
+{
+    if (!token.isNull())
+        expireToken(userManage, token);
+    if (!token.isNull())
+        return LOGGED_IN;
+    QJsonObject retToken;
+    QString ret = userManage.login(username, password, retToken);
+    if (ret.isEmpty())
+        token = retToken;
+    return ret;
+}
+
+QString RequestHandler::logout(UserManage &userManage, QJsonValue &token)
+{
+    QString ret = userManage.logout(token.toObject());
+    token = QJsonValue::Null;
+    return ret;
+}
+
+QString RequestHandler::restore(UserManage &userManage, QJsonValue &token, const QString &path)
+{
+    QString ret = userManage.restore(token.toObject(), path);
+    if (ret.isEmpty())
+        token = QJsonValue::Null; //恢复后所有用户都被登出
+    return ret;
+}
+
+void RequestHandler::expireToken(const UserManage &userManage, QJsonValue &token)
+{
+    if (!userManage.isLoggedIn(token.toObject()))
+        token = QJsonValue::Null;
+}
+
+int RequestHandler::getFlags(const QString &op)
+{
+    return operations().value(op, {0, nullptr}).flags;
+}
@@ -0,0 +1,132 @@
+﻿/**
+ * @file server.cpp
+ * @author Haolin Yang
+ * @brief 本地套接字服务的实现
+ * @version 0.1
+ * @date 2022-04-10
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+
+#include "../include/server.h"
+
+Server::Server(Database *_db, ItemManage *_itemManage, UserManage *_userManage, QObject *parent)
+    : QObject(parent), db(_db), itemManage(_itemManage), handler(_userManage)
+{
+    connect(&server, &QLocalServer::newConnection, this, &Server::acceptConnections);
+}
+
+bool Server::listen(const QString &name, int threadCount)
+{
+    //纯内存存储的多个连接同时写会返回SQLITE_LOCKED而不等待, 所有请求由同一个线程(同一个连接)处理
+    if (db->isInMemory() && threadCount > 1)
+    {
+        qWarning() << "纯内存存储只使用一个线程处理请求";
+        threadCount = 1;
+    }
+    pool.setMaxThreadCount(threadCount);
+    //线程退出时其数据库连接被关闭, 空闲线程不回收, 避免反复打开连接
+    pool.setExpiryTimeout(-1);
+    //能连接上说明有实例正在监听, 不能删除它的套接字; 连接不上才是残留的套接字文件
+    QLocalSocket probe;
+    probe.connectToServer(name);
+    if (probe.waitForConnected(1000))
+    {
+        qCritical() << "已有实例在监听" << name;
+        return false;
+    }
+    QLocalServer::removeServer(name);
+    if (!server.listen(name))
+    {
+        qCritical() << "监听失败" << name << server.errorString();
+        return false;
+    }
+    qDebug() << "开始监听" << server.fullServerName() << "线程数" << threadCount;
+    return true;
+}
+
+void Server::acceptConnections()
+{
+    while (server.hasPendingConnections())
+    {
+        QLocalSocket *socket = server.nextPendingConnection();
+        qDebug() << "新会话";
+        new Session(socket, itemManage, &handler, &pool, this);
+    }
+}
+
+Session::Session(QLocalSocket *_socket, ItemManage *_itemManage, const RequestHandler *_handler, QThreadPool *_pool, QObject *parent)
+    : QObject(parent), socket(_socket), itemManage(_itemManage), handler(_handler), pool(_pool)
+{
+    socket->setParent(this);
+    connect(socket, &QLocalSocket::readyRead, this, &Session::readRequests);
+    connect(socket, &QLocalSocket::disconnected, this, &Session::close);
+}
+
+void Session::close()
+{
+    qDebug() << "会话结束";
+    closed = true;
+    dispatchNext();
+}
+
+void Session::readRequests()
+{
+    while (socket->canReadLine())
+    {
+        QByteArray line = socket->readLine().trimmed();
+        if (!line.isEmpty())
+            pending.enqueue(line);
+    }
+    dispatchNext();
+}
+
+void Session::dispatchNext()
+{
+    if (closed)
+    {
+        if (busy)
+            return;
+        //连接断开时登出会话中的用户
+        if (!token.isNull())
+            handler->handle(QJsonObject{{"op", "logout"}}, token);
+        deleteLater();
+        return;
+    }
+    if (busy || pending.isEmpty())
+        return;
+    busy = true;
+    QByteArray line = pending.dequeue();
+    QJsonValue sessionToken = token;
+    pool->start([this, line, sessionToken]() mutable
+                {
+                    QJsonParseError error;
+                    QJsonDocument document = QJsonDocument::fromJson(line, &error);
+                    QJsonObject response;
+                    if (!document.isObject())
+                        response = QJsonObject{{"ok", false}, {"error", "请求不是Json对象 " + error.errorString()}};
+                    else
+                        response = handler->handle(document.object(), sessionToken);
+                    //修改持久化后才响应; 只等待组事务按阈值提交, 并发的请求共享同一次提交
+                    //提交失败时sync清空物品缓存, 不会再返回已回滚的修改
+                    if (!itemManage->sync())
+                    {
+                        response.insert("ok", false);
+                        response.insert("error", "数据库提交失败，修改已丢失");
+                        response.remove("result");
+                    }
+                    QByteArray reply = QJsonDocument(response).toJson(QJsonDocument::Compact) + '\n';
+                    //会话要等这里投递的调用执行后才会被删除
+                    QMetaObject::invokeMethod(
+                        this, [this, reply, sessionToken]()
+                        {
+                            busy = false;
+                            token = sessionToken;
+                            if (!closed)
+                                socket->write(reply);
+                            dispatchNext();
+                        },
+                        Qt::QueuedConnection);
+                });
+}
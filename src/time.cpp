@@ -57,6 +57,67 @@ QString Time::getTime(QJsonObject &ret)
     return {};
 }
 
+int Time::toOrdinal() const
+{
+    if (year == -1)
+        return -1;
+    return (year * 12 + month - 1) * 31 + day - 1;
+}
+
+Time Time::fromOrdinal(int ordinal)
+{
+    if (ordinal < 0)
+        return Time(-1, -1, -1);
+    return Time(ordinal / 31 / 12, ordinal / 31 % 12 + 1, ordinal % 31 + 1);
+}
+
+Time Time::fromJson(const QJsonObject &json)
+{
+    //给出但不是整数的部分(包括超出int范围的)记为-2, 不能当作缺少而被忽略
+    auto part = [&json](const char *key)
+    { return json.contains(key) ? json.value(key).toInt(-2) : -1; };
+    Time time(part("year"), part("month"), part("day"));
+    if (time.year > MAX_YEAR)
+        time.year = -2;
+    return time;
+}
+
+bool Time::isValidPartial(const Time &partial)
+{
+    return (partial.year == -1 || (partial.year >= 0 && partial.year <= MAX_YEAR)) &&
+           (partial.month == -1 || (partial.month >= 1 && partial.month <= 12)) &&
+           (partial.day == -1 || (partial.day >= 1 && partial.day <= 31));
+}
+
+bool Time::partialToRange(const Time &partial, Time &from, Time &to)
+{
+    //超出范围的月、日会被toOrdinal换算到下一年或下一月
+    if (!isValidPartial(partial))
+    {
+        from = to = Time(-1, -1, -1);
+        return false;
+    }
+    if (partial.year == -1)
+    {
+        from = to = Time(-1, -1, -1);
+        return partial.month == -1 && partial.day == -1;
+    }
+    if (partial.month == -1)
+    {
+        from = Time(partial.year, 1, 1);
+        to = Time(partial.year, 12, 31);
+        return partial.day == -1;
+    }
+    if (partial.day == -1)
+    {
+        from = Time(partial.year, partial.month, 1);
+        to = Time(partial.year, partial.month, 31);
+        return true;
+    }
+    from = to = partial;
+    return true;
+}
+
 bool Time::isDue() const
 {
     return ((year < curYear) || (year == curYear && month < curMonth) || (year == curYear && month == curMonth && day <= curDay));
@@ -11,10 +11,17 @@
 
 #include "../include/user.h"
 
-QString UserManage::verify(const QJsonObject &token) const
+QString UserManage::verify(const QJsonObject &token, QSharedPointer<User> *user) const
 {
-    if (!token.contains("username") ||
-        !userMap.value(token["username"].toString(), nullptr) ||
+    QSharedPointer<User> found;
+    if (token.contains("username") && token.contains("session"))
+    {
+        QReadLocker locker(&userLock);
+        //会话号必须仍属于该用户, 登出的会话不能再使用
+        if (sessions.value(token["session"].toInt(-1)) == token["username"].toString())
+            found = userMap.value(token["username"].toString(), nullptr);
+    }
+    if (!found ||
         !token.contains("iss") ||
         token["iss"] != "Haolin Yang")
     {
@@ -24,6 +31,9 @@ QString UserManage::verify(const QJsonObject &token) const
     else
     {
         qDebug() << "用户 " << token["username"].toString() << " 验证成功";
+        //返回用户对象，即使之后被其他会话登出，调用者仍可安全使用
+        if (user)
+            *user = found;
         return token["username"].toString();
     }
 }
@@ -33,19 +43,23 @@ QString UserManage::addBalance(const QJsonObject &token, int addend) const
     if (addend > (int)1e9 || addend < (int)-1e9)
         return "单次余额改变量不能超过1000000000";
 
-    QString username = verify(token);
+    QSharedPointer<User> user;
+    QString username = verify(token, &user);
     if (username.isEmpty())
         return "验证失败";
 
-    if (userMap[username]->getBalance() + addend < 0)
+    QMutexLocker locker(&balanceMutex);
+    if (user->getBalance() + addend < 0)
         return "余额不能为负";
 
-    if (userMap[username]->getBalance() + addend > (int)1e9)
+    if (user->getBalance() + addend > (int)1e9)
         return "余额上限为1000000000";
 
-    qDebug() << "修改用户 " << username << " 成功, 余额为 " << userMap[username]->getBalance() + addend;
-    db->modifyUserBalance(username, userMap[username]->getBalance() + addend);
-    userMap[username]->addBalance(addend);
+    //数据库修改失败时不改动缓存的余额
+    if (!db->modifyUserBalance(username, user->getBalance() + addend))
+        return "数据库错误";
+    qDebug() << "修改用户 " << username << " 成功, 余额为 " << user->getBalance() + addend;
+    user->addBalance(addend);
     return {};
 }
 
@@ -54,92 +68,320 @@ QString UserManage::transferBalance(const QJsonObject &token, int balance, const
     if (balance >= (int)1e9 || balance <= (int)-1e9)
         return "单次余额改变量不能超过1000000000";
 
+    QSharedPointer<User> user;
+    QString username = verify(token, &user);
+    if (username.isEmpty())
+        return "验证失败";
+
+    //余额检查和修改之间不能插入其他转账
+    QMutexLocker locker(&balanceMutex);
+    QString ret = checkTransfer(user, balance, dstUser);
+    if (!ret.isEmpty())
+        return ret;
+
+    if (!db->transferBalance(username, dstUser, balance))
+        return "转账失败";
+
+    applyBalance(username, -balance);
+    applyBalance(dstUser, balance);
+    qDebug() << dstUser << "获得金额: " << balance;
+    return {};
+}
+
+QString UserManage::checkTransfer(const QSharedPointer<User> &user, int balance, const QString &dstUser) const
+{
     if (!db->queryUserByName(dstUser))
         return "无法查到另一个用户" + dstUser;
 
     int dstBalance = db->queryBalanceByName(dstUser);
-    if (dstUser + balance >= (int)1e9)
+    if (dstBalance + balance >= (int)1e9)
         return "余额不能大于1000000000";
 
-    if (dstUser + balance < 0)
+    if (dstBalance + balance < 0)
         return "余额不能为负";
 
-    QString ret = addBalance(token, -balance);
-    if (!ret.isEmpty())
-        return ret;
+    if (user->getBalance() - balance < 0)
+        return "余额不能为负";
 
-    db->modifyUserBalance(dstUser, dstBalance + balance);
-    qDebug() << dstUser << "获得金额: " << balance;
+    if (user->getBalance() - balance > (int)1e9)
+        return "余额上限为1000000000";
     return {};
 }
 
-QString UserManage::queryItem(const QJsonObject &token, const QJsonObject &filter, QJsonArray &ret) const
+void UserManage::applyBalance(const QString &username, int addend) const
+{
+    QSharedPointer<User> user;
+    {
+        QReadLocker locker(&userLock);
+        user = userMap.value(username, nullptr);
+    }
+    QMutexLocker locker(&balanceMutex);
+    if (user)
+        user->addBalance(addend);
+}
+
+QString UserManage::parseItemFilter(const QJsonObject &token, const QJsonObject &filter, ItemFilter &ret) const
 {
-    bool ok;
     if (!filter.contains("type"))
         return "缺少type键";
-    int cnt;
-    QList<QSharedPointer<Item>> result;
-    QString username = verify(token);
+    QSharedPointer<User> user;
+    QString username = verify(token, &user);
+    if (username.isEmpty())
+        return "验证失败";
 
-    if (filter["type"].toInt() == 0 && userMap[username]->getUserType() != ADMINISTRATOR)
+    if (filter["type"].toInt() == 0 && user->getUserType() != ADMINISTRATOR)
         return "非管理员不能查看所有物品";
 
-    int id = -1;
+    ret = ItemFilter();
     Time sendingTime(-1, -1, -1), receivingTime(-1, -1, -1);
-    QString srcName(""), dstName("");
     if (filter.contains("id"))
-        id = filter["id"].toInt();
+        ret.id = filter["id"].toInt();
     if (filter.contains("sendingTime_Year"))
-        sendingTime.year = filter["sendingTime_Year"].toInt();
+        sendingTime.year = filter["sendingTime_Year"].toInt(-2);
     if (filter.contains("sendingTime_Month"))
-        sendingTime.month = filter["sendingTime_Month"].toInt();
+        sendingTime.month = filter["sendingTime_Month"].toInt(-2);
     if (filter.contains("sendingTime_Day"))
-        sendingTime.day = filter["sendingTime_Day"].toInt();
+        sendingTime.day = filter["sendingTime_Day"].toInt(-2);
     if (filter.contains("receivingTime_Year"))
-        receivingTime.year = filter["receivingTime_Year"].toInt();
+        receivingTime.year = filter["receivingTime_Year"].toInt(-2);
     if (filter.contains("receivingTime_Month"))
-        receivingTime.month = filter["receivingTime_Month"].toInt();
+        receivingTime.month = filter["receivingTime_Month"].toInt(-2);
     if (filter.contains("receivingTime_Day"))
-        receivingTime.day = filter["receivingTime_Day"].toInt();
+        receivingTime.day = filter["receivingTime_Day"].toInt(-2);
     if (filter.contains("srcName"))
-        srcName = filter["srcName"].toString();
+        ret.srcName = filter["srcName"].toString();
     if (filter.contains("dstName"))
-        dstName = filter["dstName"].toString();
+        ret.dstName = filter["dstName"].toString();
+    if (filter.contains("after_id"))
+        ret.afterId = filter["after_id"].toInt();
+    if (filter.contains("limit"))
+    {
+        ret.limit = filter["limit"].toInt();
+        if (ret.limit <= 0)
+            return "limit应为正整数";
+    }
+    if (filter.contains("desc"))
+        ret.descending = filter["desc"].toBool();
+
+    //不是整数的年、月、日读为-2, 由isValidPartial拒绝
+    if (!Time::isValidPartial(sendingTime))
+        return "寄送时间的年应在0~9999之间, 月应在1~12之间, 日应在1~31之间";
+    if (!Time::isValidPartial(receivingTime))
+        return "接收时间的年应在0~9999之间, 月应在1~12之间, 日应在1~31之间";
+    //年、月、日形式的条件中按年、年月或年月日的前缀转换为日期区间, 其余的月、日作为单独的条件
+    splitPartialTime(sendingTime, ret.sendingFrom, ret.sendingTo, ret.sendingMonth, ret.sendingDay);
+    splitPartialTime(receivingTime, ret.receivingFrom, ret.receivingTo, ret.receivingMonth, ret.receivingDay);
+    //区间的端点也可以只给出年或年月, 下限取其中最早的一天, 上限取其中最晚的一天
+    Time from, to;
+    if (filter.contains("sendingTime_From"))
+    {
+        if (!Time::partialToRange(Time::fromJson(filter["sendingTime_From"].toObject()), from, to))
+            return "寄送起始日期只能给出年、年月或年月日, 年应在0~9999之间, 月应在1~12之间, 日应在1~31之间";
+        ret.sendingFrom = from;
+    }
+    if (filter.contains("sendingTime_To"))
+    {
+        if (!Time::partialToRange(Time::fromJson(filter["sendingTime_To"].toObject()), from, to))
+            return "寄送截止日期只能给出年、年月或年月日, 年应在0~9999之间, 月应在1~12之间, 日应在1~31之间";
+        ret.sendingTo = to;
+    }
+    if (filter.contains("receivingTime_From"))
+    {
+        if (!Time::partialToRange(Time::fromJson(filter["receivingTime_From"].toObject()), from, to))
+            return "接收起始日期只能给出年、年月或年月日, 年应在0~9999之间, 月应在1~12之间, 日应在1~31之间";
+        ret.receivingFrom = from;
+    }
+    if (filter.contains("receivingTime_To"))
+    {
+        if (!Time::partialToRange(Time::fromJson(filter["receivingTime_To"].toObject()), from, to))
+            return "接收截止日期只能给出年、年月或年月日, 年应在0~9999之间, 月应在1~12之间, 日应在1~31之间";
+        ret.receivingTo = to;
+    }
 
     switch (filter["type"].toInt())
     {
     case 0:
-        cnt = itemManage->queryByFilter(result, id, sendingTime, receivingTime, srcName, dstName);
         break;
     case 1:
-        cnt = itemManage->queryByFilter(result, id, sendingTime, receivingTime, username, dstName);
+        ret.srcName = username;
         break;
     case 2:
-        cnt = itemManage->queryByFilter(result, id, sendingTime, receivingTime, srcName, username);
+        ret.dstName = username;
         break;
     default:
         return "type键的值有误";
         break;
     }
+    return {};
+}
 
-    for (const QSharedPointer<Item> &item : result)
+void UserManage::splitPartialTime(const Time &partial, Time &from, Time &to, int &month, int &day)
+{
+    Time prefix = partial;
+    month = day = -1;
+    if (partial.year == -1)
     {
-        QJsonObject itemJson;
-        itemJson.insert("id", item->getId());
-        itemJson.insert("cost", item->getCost());
-        itemJson.insert("state", item->getState());
-        itemJson.insert("sendingTime_Year", item->getSendingTime().year);
-        itemJson.insert("sendingTime_Month", item->getSendingTime().month);
-        itemJson.insert("sendingTime_Day", item->getSendingTime().day);
-        itemJson.insert("receivingTime_Year", item->getReceivingTime().year);
-        itemJson.insert("receivingTime_Month", item->getReceivingTime().month);
-        itemJson.insert("receivingTime_Day", item->getReceivingTime().day);
-        itemJson.insert("srcName", item->getSrcName());
-        itemJson.insert("dstName", item->getDstName());
-        itemJson.insert("description", item->getDescription());
-        ret.append(itemJson);
+        month = partial.month;
+        day = partial.day;
+        prefix = Time(-1, -1, -1);
+    }
+    else if (partial.month == -1)
+    {
+        day = partial.day;
+        prefix.day = -1;
+    }
+    Time::partialToRange(prefix, from, to);
+}
+
+QJsonObject UserManage::item2Json(const Item &item)
+{
+    QJsonObject itemJson;
+    itemJson.insert("id", item.getId());
+    itemJson.insert("cost", item.getCost());
+    itemJson.insert("state", item.getState());
+    itemJson.insert("sendingTime_Year", item.getSendingTime().year);
+    itemJson.insert("sendingTime_Month", item.getSendingTime().month);
+    itemJson.insert("sendingTime_Day", item.getSendingTime().day);
+    itemJson.insert("receivingTime_Year", item.getReceivingTime().year);
+    itemJson.insert("receivingTime_Month", item.getReceivingTime().month);
+    itemJson.insert("receivingTime_Day", item.getReceivingTime().day);
+    itemJson.insert("srcName", item.getSrcName());
+    itemJson.insert("dstName", item.getDstName());
+    itemJson.insert("description", item.getDescription());
+    return itemJson;
+}
+
+QString UserManage::queryItem(const QJsonObject &token, const QJsonObject &filter, QJsonArray &ret) const
+{
+    return queryItem(token, filter, [&ret](const QJsonObject &item)
+                     { ret.append(item); });
+}
+
+QString UserManage::queryItem(const QJsonObject &token, const QJsonObject &filter, const std::function<void(const QJsonObject &)> &visitor) const
+{
+    ItemFilter itemFilter;
+    QString error = parseItemFilter(token, filter, itemFilter);
+    if (!error.isEmpty())
+        return error;
+
+    itemManage->visitByFilter(itemFilter, [&visitor](const Item &item)
+                              {
+                                  visitor(item2Json(item));
+                                  return true;
+                              });
+    return {};
+}
+
+QString UserManage::countItem(const QJsonObject &token, const QJsonObject &filter, int &ret) const
+{
+    ItemFilter itemFilter;
+    QString error = parseItemFilter(token, filter, itemFilter);
+    if (!error.isEmpty())
+        return error;
+
+    ret = itemManage->countByFilter(itemFilter);
+    if (ret < 0)
+        return "统计失败";
+    return {};
+}
+
+QString UserManage::aggregateItem(const QJsonObject &token, const QJsonObject &filter, QJsonArray &ret) const
+{
+    QSharedPointer<User> user;
+    QString username = verify(token, &user);
+    if (username.isEmpty())
+        return "验证失败";
+    if (user->getUserType() != ADMINISTRATOR)
+        return "非管理员不能查看统计";
+
+    ItemFilter itemFilter;
+    QString error = parseItemFilter(token, filter, itemFilter);
+    if (!error.isEmpty())
+        return error;
+
+    int groupBy = 0;
+    for (const QJsonValue &column : filter["groupBy"].toArray())
+    {
+        if (column.toString() == "srcName")
+            groupBy |= GROUP_BY_SRC_NAME;
+        else if (column.toString() == "state")
+            groupBy |= GROUP_BY_STATE;
+        else if (column.toString() == "sendingTime")
+            groupBy |= GROUP_BY_SENDING_DATE;
+        else
+            return "groupBy键的值有误";
     }
+
+    QVector<ItemAggregate> result;
+    if (itemManage->aggregateByFilter(result, itemFilter, groupBy) < 0)
+        return "统计失败";
+
+    for (const ItemAggregate &row : result)
+    {
+        QJsonObject rowJson;
+        rowJson.insert("count", row.count);
+        rowJson.insert("revenue", row.revenue);
+        if (groupBy & GROUP_BY_SRC_NAME)
+            rowJson.insert("srcName", row.srcName);
+        if (groupBy & GROUP_BY_STATE)
+            rowJson.insert("state", row.state);
+        if (groupBy & GROUP_BY_SENDING_DATE)
+        {
+            rowJson.insert("sendingTime_Year", row.sendingTime.year);
+            rowJson.insert("sendingTime_Month", row.sendingTime.month);
+            rowJson.insert("sendingTime_Day", row.sendingTime.day);
+        }
+        ret.append(rowJson);
+    }
+    return {};
+}
+
+QString UserManage::snapshot(const QJsonObject &token, const QString &path) const
+{
+    QSharedPointer<User> user;
+    QString username = verify(token, &user);
+    if (username.isEmpty())
+        return "验证失败";
+    if (user->getUserType() != ADMINISTRATOR)
+        return "非管理员不能保存快照";
+    if (!db->snapshot(path))
+        return "保存快照失败";
+    return {};
+}
+
+QString UserManage::restore(const QJsonObject &token, const QString &path)
+{
+    QSharedPointer<User> user;
+    QString username = verify(token, &user);
+    if (username.isEmpty())
+        return "验证失败";
+    if (user->getUserType() != ADMINISTRATOR)
+        return "非管理员不能恢复快照";
+    if (!itemManage->restore(path))
+        return "恢复快照失败";
+    //已登录用户的余额等信息可能已与快照不同，全部登出
+    QWriteLocker locker(&userLock);
+    userMap.clear();
+    sessions.clear();
+    sessionCount.clear();
+    return {};
+}
+
+QString UserManage::explainItemQuery(const QJsonObject &token, const QJsonObject &filter, QStringList &ret) const
+{
+    QSharedPointer<User> user;
+    QString username = verify(token, &user);
+    if (username.isEmpty())
+        return "验证失败";
+    if (user->getUserType() != ADMINISTRATOR)
+        return "非管理员不能查看查询计划";
+
+    ItemFilter itemFilter;
+    QString error = parseItemFilter(token, filter, itemFilter);
+    if (!error.isEmpty())
+        return error;
+
+    ret = itemManage->explainByFilter(itemFilter);
     return {};
 }
 
@@ -147,11 +389,11 @@ QString UserManage::registerUser(const QString &username, const QString &passwor
 {
     if (username.isEmpty() || username.size() > 10)
         return "用户名长度应该在1~10之间";
-    if (db->queryUserByName(username))
-        return "该用户名已被注册";
     if (type == ADMINISTRATOR)
         return "管理员类不支持注册";
-    db->insertUser(username, password, type, 0, name, phoneNumber, address);
+    //不先查询再插入: 并发注册同一用户名时由主键约束决定谁成功
+    if (!db->insertUser(username, password, type, 0, name, phoneNumber, address))
+        return db->queryUserByName(username) ? "该用户名已被注册" : "数据库错误";
     qDebug() << "用户 " << username << " 注册成功";
     return {};
 }
@@ -166,6 +408,7 @@ QString UserManage::login(const QString &username, const QString &password, QJso
     QString retAddress;
     if (db->queryUserByName(username, retPassword, retType, retBalance, retName, retPhoneNumber, retAddress) && retPassword == password)
     {
+        QWriteLocker locker(&userLock);
         switch (retType)
         {
         case CUSTOMER:
@@ -180,8 +423,13 @@ QString UserManage::login(const QString &username, const QString &password, QJso
             return "数据库中用户类型错误";
             break;
         }
+        //同一用户可以同时登录多个会话, 共享同一个用户对象
+        int session = ++lastSession;
+        sessions.insert(session, username);
+        ++sessionCount[username];
         token.insert("iss", "Haolin Yang");
         token.insert("username", username);
+        token.insert("session", session);
         return {};
     }
     else
@@ -193,11 +441,28 @@ QString UserManage::logout(const QJsonObject &token)
     QString username = verify(token);
     if (username.isEmpty())
         return "验证失败";
+    QWriteLocker locker(&userLock);
+    //同一凭据并发登出时只有一次成功
+    if (!sessions.remove(token["session"].toInt()))
+        return "验证失败";
     qDebug() << "用户 " << username << " 登出";
-    userMap.remove(username);
+    //该用户的最后一个会话登出时才释放用户对象
+    if (--sessionCount[username] == 0)
+    {
+        sessionCount.remove(username);
+        userMap.remove(username);
+    }
     return {};
 }
 
+bool UserManage::isLoggedIn(const QJsonObject &token) const
+{
+    if (!token.contains("username") || !token.contains("session"))
+        return false;
+    QReadLocker locker(&userLock);
+    return sessions.value(token["session"].toInt(-1)) == token["username"].toString();
+}
+
 QString UserManage::changePassword(const QJsonObject &token, const QString &newPassword) const
 {
     QString username = verify(token);
@@ -210,27 +475,32 @@ QString UserManage::changePassword(const QJsonObject &token, const QString &newP
 
 QString UserManage::getUserInfo(const QJsonObject &token, QJsonObject &ret) const
 {
-    QString username = verify(token);
+    QSharedPointer<User> user;
+    QString username = verify(token, &user);
     if (username.isEmpty())
         return "验证失败";
     qDebug() << "获取用户" << username << " 的信息";
     ret.insert("username", username);
-    ret.insert("type", userMap[username]->getUserType());
-    ret.insert("balance", userMap[username]->getBalance());
-    ret.insert("name", userMap[username]->getName());
-    ret.insert("phonenumber", userMap[username]->getPhoneNumber());
-    ret.insert("address", userMap[username]->getAddress());
+    ret.insert("type", user->getUserType());
+    {
+        QMutexLocker locker(&balanceMutex);
+        ret.insert("balance", user->getBalance());
+    }
+    ret.insert("name", user->getName());
+    ret.insert("phonenumber", user->getPhoneNumber());
+    ret.insert("address", user->getAddress());
     return {};
 }
 
 QString UserManage::queryAllUserInfo(const QJsonObject &token, QJsonArray &ret) const
 {
-    QString username = verify(token);
+    QSharedPointer<User> user;
+    QString username = verify(token, &user);
     if (username.isEmpty())
         return "验证失败";
-    if (userMap[username]->getUserType() != ADMINISTRATOR)
+    if (user->getUserType() != ADMINISTRATOR)
         return "非管理员不能查看所有用户信息";
-    for (QString username : db->usernameSet)
+    for (const QString &username : db->queryAllUsername())
     {
         QString retPassword;
         int retType;
@@ -253,10 +523,11 @@ QString UserManage::queryAllUserInfo(const QJsonObject &token, QJsonArray &ret)
 
 QString UserManage::sendItem(const QJsonObject &token, const QJsonObject &info) const
 {
-    QString username = verify(token);
+    QSharedPointer<User> user;
+    QString username = verify(token, &user);
     if (username.isEmpty())
         return "验证失败";
-    if (userMap[username]->getUserType() != CUSTOMER)
+    if (user->getUserType() != CUSTOMER)
         return "非用户不能发出快递";
 
     if (!info.contains("dstName") || !info.contains("description"))
@@ -275,12 +546,47 @@ QString UserManage::sendItem(const QJsonObject &token, const QJsonObject &info)
     if (retType != CUSTOMER)
         return "你只能给用户寄出快递";
 
-    QString ret = transferBalance(token, 15, "ADMINISTRATOR");
-    if (!ret.isEmpty())
-        return ret;
+    //运费转给管理员和物品插入作为一次修改完成, 组提交模式下由写线程合并进组事务
+    //先取余额锁再开始修改: 修改时持有SQLite的写锁, 此时再等余额锁会与先取余额锁再等写锁的addBalance互相等待
+    int id = -1;
+    {
+        QMutexLocker locker(&balanceMutex);
+        QString ret = checkTransfer(user, 15, "admin");
+        if (!ret.isEmpty())
+            return ret;
+
+        Time sendingTime(Time::getCurYear(), Time::getCurMonth(), Time::getCurDay());
+        QString dstName = info["dstName"].toString();
+        QString description = info["description"].toString();
+        ret = "数据库错误";
+        //修改可能在写线程上执行, 其中不能再取余额锁
+        if (!db->groupWrite([&]()
+                            {
+                                id = itemManage->insertItem(15, PENDING_REVEICING, sendingTime, Time(-1, -1, -1), username, dstName, description);
+                                if (id < 0)
+                                {
+                                    ret = "物品添加失败";
+                                    return false;
+                                }
+                                if (!db->transferBalance(username, "admin", 15))
+                                {
+                                    ret = "转账失败";
+                                    return false;
+                                }
+                                return true;
+                            }))
+            return ret;
+        applyBalance(username, -15);
+        applyBalance("admin", 15);
+    }
 
-    Time sendingTime(Time::getCurYear(), Time::getCurMonth(), Time::getCurDay());
-    int id = itemManage->insertItem(15, PENDING_REVEICING, sendingTime, Time(-1, -1, -1), username, info["dstName"].toString(), info["description"].toString());
+    //组提交模式下修改执行完尚未提交; 提交失败时转账随物品一起丢失, 恢复缓存的余额
+    if (!db->waitGroupCommit())
+    {
+        applyBalance(username, 15);
+        applyBalance("admin", -15);
+        return "数据库错误";
+    }
     qDebug() << "添加快递单号为" << id;
 
     return {};
@@ -288,24 +594,28 @@ QString UserManage::sendItem(const QJsonObject &token, const QJsonObject &info)
 
 QString UserManage::receiveItem(const QJsonObject &token, const QJsonObject &info) const
 {
-    QString username = verify(token);
+    QSharedPointer<User> user;
+    QString username = verify(token, &user);
     if (username.isEmpty())
         return "验证失败";
-    if (userMap[username]->getUserType() != CUSTOMER)
+    if (user->getUserType() != CUSTOMER)
         return "非用户不能接收快递";
 
     if (!info.contains("id"))
         return "快递物品信息不全";
 
-    QSharedPointer<Item> result;
+    ItemList result;
     if (!itemManage->queryById(result, info["id"].toInt()))
         return "不存在运单号为该ID的物品";
-    if (result->getDstName() != username)
+    if (result.front().getDstName() != username)
         return "这不是您的快递";
-    if (!result->getSendingTime().isDue())
+    if (!result.front().getSendingTime().isDue())
         return {"该快递还未到达"};
 
-    itemManage->modifyState(info["id"].toInt(), RECEIVED);
-    itemManage->modifyReceivingTime(info["id"].toInt(), Time(Time::getCurYear(), Time::getCurMonth(), Time::getCurDay()));
+    int changed = itemManage->markReceived(info["id"].toInt(), Time(Time::getCurYear(), Time::getCurMonth(), Time::getCurDay()));
+    if (changed < 0)
+        return "数据库错误";
+    if (changed == 0)
+        return "该快递已签收";
     return {};
 }